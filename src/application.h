@@ -1,180 +1,321 @@
 #pragma once
 
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
 #include <boost/json.hpp>
 
-#include "collision_detector.h"
 #include "db_connection.h"
+#include "game_state.h"
+#include "metrics.h"
 #include "model.h"
 #include "player.h"
 #include "serialization.h"
+#include "tick_pipeline.h"
 
+#include <atomic>
+#include <algorithm>
 #include <chrono>
-#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace json = boost::json;
+namespace net = boost::asio;
 
 namespace application {
 
 	class Application {
 	public:
-		Application(model::Game& game, players::Players& players, players::PlayerTokens& tokens, conn_pool::ConnectionPool& conn_pool, int save_period, std::string save_path) 
-            : game_(game)
+        using Strand = net::strand<net::io_context::executor_type>;
+
+        // Receives the snapshot of a map after every tick and sends it in the
+        // encoding of its client.
+        using StateSink = game_state::StateSubscribers::Sink;
+
+		Application(net::io_context& ioc, model::Game& game, players::Players& players, players::PlayerTokens& tokens, conn_pool::ConnectionPool& conn_pool, int save_period, std::string save_path,
+                    std::chrono::milliseconds tick_period) 
+            : strand_(net::make_strand(ioc))
+            , game_(game)
             , players_(players)
             , player_tokens_(tokens)
             , conn_pool_(conn_pool)
             , save_period_(save_period)
             , save_path_(save_path)
+            , profiler_(tick_period)
         {
+            for (const auto& map : game_.GetMaps()) {
+                session_strands_.emplace(map->GetId(), net::make_strand(ioc));
+                session_metrics_.try_emplace(map->GetId());
+                snapshots_.try_emplace(map->GetId());
+                updates_.try_emplace(map->GetId());
+                subscribers_.try_emplace(map->GetId());
+            }
+            // Sessions restored from the saved state are seen by readers right away.
+            for (const auto& [map_id, game_session] : game_.GetGameSessions())
+                PublishSnapshot(game_session);
         }
 
-        void Tick(std::chrono::milliseconds delta) {
-            game_.GenerateLoot(delta);
-            int time = delta.count();
-            int msc_in_sec = 1000;            
-            game_.AddTime(1.0 * time / msc_in_sec);
-            const double timer = game_.GetTimer();
-            
-            if(!save_path_.empty() && save_period_ != 0 && prev_saving_ < timer * msc_in_sec - save_period_) {
-                serializer::SerializeGame(save_path_, game_, players_, player_tokens_);
-                prev_saving_ = timer * msc_in_sec;
-            }
+        // Strand of the work that spans all maps: the game clock and state saving.
+        Strand& GetStrand() {
+            return strand_;
+        }
 
-            const double retirement_time = game_.GetRetirementTime();
-            for (auto& player : players_.GetPlayers()) {
-                auto game_session = player->GetGameSession();
-                game_session.RefreshTimer(timer);
-                auto& dog = player->GetDog();
-                dog.RefreshTime(1.0 * time / msc_in_sec);
+        // Every map is simulated on its own strand. The strands are created once for
+        // the maps known at load time, so the table is read without locking.
+        Strand& GetSessionStrand(const model::Map::Id& map_id) {
+            return session_strands_.at(map_id);
+        }
 
-                if(!player->IsOnline())
-                    continue;
+        // Only holds atomic counters, so it is read from any thread.
+        const model::TickProfiler& GetProfiler() const noexcept {
+            return profiler_;
+        }
 
-                auto position = dog.GetPosition();
-                int x = std::round(position.x);
-                int y = std::round(position.y);
-
-                double speed_x = dog.GetSpeed().x;
-                double speed_y = dog.GetSpeed().y;
-                auto roads = game_session.GetMap().GetRoadMap({ x, y });
-                bool needed_to_stop = false;
-
-                double expected_x = position.x + speed_x * time / msc_in_sec;
-                double current_x = position.x;
-                double expected_y = position.y + speed_y * time / msc_in_sec;
-                double current_y = position.y;
-
-                const double ROAD_WIDTH = 0.8;
-                if (speed_x - std::numeric_limits<double>::epsilon() > 0) {
-                    for (const auto& road : roads) {
-                        double possible_x_max = std::max(road->GetStart().x, road->GetEnd().x) * 1.0 + ROAD_WIDTH / 2;
-                        if (expected_x > possible_x_max + std::numeric_limits<double>::epsilon() && expected_x > current_x + std::numeric_limits<double>::epsilon()) {
-                            current_x = std::max(current_x, possible_x_max);
-                            needed_to_stop = true;
-                        }
-                        else if (expected_x > current_x + std::numeric_limits<double>::epsilon()) {
-                            current_x = expected_x;
-                            needed_to_stop = false;
-                        }
-                    }
-                }
-                else if (speed_x + std::numeric_limits<double>::epsilon() < 0) {
-                    for (const auto& road : roads) {
-                        double possible_x_min = std::min(road->GetStart().x, road->GetEnd().x) * 1.0 - ROAD_WIDTH / 2;
-                        if (expected_x < possible_x_min - std::numeric_limits<double>::epsilon() && expected_x < current_x - std::numeric_limits<double>::epsilon()) {
-                            current_x = std::min(current_x, possible_x_min);
-                            needed_to_stop = true;
-                        }
-                        else if (expected_x < current_x - std::numeric_limits<double>::epsilon()) {
-                            current_x = expected_x;
-                            needed_to_stop = false;
-                        }
-                    }
-                }
-                else if (speed_y - std::numeric_limits<double>::epsilon() > 0) {
-                    for (const auto& road : roads) {
-                        double possible_y_max = std::max(road->GetStart().y, road->GetEnd().y) * 1.0 + ROAD_WIDTH / 2;
-                        if (expected_y > possible_y_max + std::numeric_limits<double>::epsilon() && expected_y > current_y + std::numeric_limits<double>::epsilon()) {
-                            current_y = std::max(current_y, possible_y_max);
-                            needed_to_stop = true;
-                        }
-                        else if (expected_y > current_y + std::numeric_limits<double>::epsilon()) {
-                            current_y = expected_y;
-                            needed_to_stop = false;
-                        }
-                    }
-                }
-                else if (speed_y + std::numeric_limits<double>::epsilon() < 0) {
-                    for (const auto& road : roads) {
-                        double possible_y_min = std::min(road->GetStart().y, road->GetEnd().y) * 1.0 - ROAD_WIDTH / 2;
-                        if (expected_y < possible_y_min - std::numeric_limits<double>::epsilon() && expected_y < current_y - std::numeric_limits<double>::epsilon()) {
-                            current_y = std::min(current_y, possible_y_min);
-                            needed_to_stop = true;
-                        }
-                        else if (expected_y < current_y - std::numeric_limits<double>::epsilon()) {
-                            current_y = expected_y;
-                            needed_to_stop = false;
-                        }
-                    }
-                }
+        // Like the strands, the metrics of the maps are created once at load time
+        // and only their atomic counters change afterwards.
+        const metrics::SessionMetrics& GetSessionMetrics(const model::Map::Id& map_id) const {
+            return session_metrics_.at(map_id);
+        }
 
-                if(dog.GetRetirementTime() > retirement_time || std::abs(dog.GetRetirementTime() - retirement_time) < std::numeric_limits<double>::epsilon()) {
-                    player->SetOffline();
-                    game_session.AddRetiredOne();
-                    {
-                        auto conn = conn_pool_.GetConnection();
-                        pqxx::work work{*conn};
-                        double total_time = (dog.GetCurrentTime() - dog.GetStartTime());
-                        work.exec_params("INSERT INTO retired_players (id, name, score, play_time_ms) VALUES ($1, $2, $3, $4)"_zv, 
-                            dog.GetUUID().ToString(), dog.GetName(), player->GetValue(), total_time);
-                        work.commit();
-                    }
+        // Read-only requests take the last snapshot of their map on whatever thread
+        // they arrive, so they never queue behind a tick or a mutating request.
+        // Returns nullptr for a map that has no session.
+        game_state::SnapshotPtr GetSnapshot(const model::Map::Id& map_id) const {
+            return snapshots_.at(map_id).load(std::memory_order_acquire);
+        }
+
+        // Runs on the strand of the session's map at the end of a tick. Readers
+        // holding the previous snapshot keep it until they are done. The strand is
+        // the only writer, so the previous snapshot is still the published one.
+        void PublishSnapshot(const model::GameSession& game_session) {
+            const model::Map::Id& map_id = game_session.GetMap().GetId();
+            auto& published = snapshots_.at(map_id);
+            const game_state::SnapshotPtr previous = published.load(std::memory_order_acquire);
+            published.store(game_state::WorldSnapshot::CaptureTick(game_session, players_.GetPlayers(map_id), previous),
+                std::memory_order_release);
+            updates_.at(map_id).dirty = false;
+        }
+
+        // Runs on the strand of the session's map after a join or a movement
+        // command. The snapshot is updated once for all the commands that are
+        // queued on the strand by then, and every on_published is called after
+        // it, so a command is answered only once readers see it but a burst of
+        // commands costs one capture of the map and no tick of the history.
+        void UpdateSnapshot(const model::GameSession& game_session, std::function<void()> on_published = {}) {
+            const model::Map::Id& map_id = game_session.GetMap().GetId();
+            PendingUpdate& update = updates_.at(map_id);
+            update.dirty = true;
+            if (on_published)
+                update.waiting.push_back(std::move(on_published));
+            if (update.scheduled)
+                return;
+            update.scheduled = true;
+            net::post(GetSessionStrand(map_id), [this, &game_session] {
+                const model::Map::Id& map_id = game_session.GetMap().GetId();
+                PendingUpdate& update = updates_.at(map_id);
+                update.scheduled = false;
+                // A tick that ran in between has already published the commands.
+                if (update.dirty) {
+                    auto& published = snapshots_.at(map_id);
+                    const game_state::SnapshotPtr previous = published.load(std::memory_order_acquire);
+                    published.store(game_state::WorldSnapshot::CaptureUpdate(game_session, players_.GetPlayers(map_id), previous),
+                        std::memory_order_release);
+                    update.dirty = false;
                 }
+                const std::vector<std::function<void()>> waiting = std::move(update.waiting);
+                update.waiting.clear();
+                for (const auto& on_published : waiting)
+                    on_published();
+            });
+        }
 
-                if (needed_to_stop)
-                    dog.Stop();
-                player->GetDog().SetPosition(current_x, current_y);
+        // Runs on the strand of the map. The sink gets the current state right away
+        // and then the state at the end of every tick.
+        void Subscribe(const model::Map::Id& map_id, StateSink sink) {
+            if (const game_state::SnapshotPtr snapshot = GetSnapshot(map_id)) {
+                if (!sink(*snapshot))
+                    return;
             }
+            subscribers_.at(map_id).Add(std::move(sink));
+        }
 
-            collision_detector::LootGathererProvider provider(game_, players_);
-            std::vector<collision_detector::GatheringEvent> events = FindGatherEvents(provider);
-            for(const auto& event : events) {
-                int item_id = game_.GetLootObjects().at(event.item_id)->GetId();
-                for(auto& game_session : game_.GetGameSessions()) {
-                    if(!game_session.second.GetLootObjects().contains(item_id)) {
-                        continue;  //here was "break"
-                    }
-                    auto& loot = game_session.second.GetLootObjects()[item_id];
-                    if(players_.GetPlayers()[event.gatherer_id]->GetDog().TakeLoot(loot)) {
-                        game_.GetLootObjects().at(event.item_id)->SetInvisible();
-                        game_session.second.DeleteLootObject(item_id);
-                    }
-                    
-                    break;
-                }
+        // Runs on the strand of the session's map.
+        void PublishSessionMetrics(const model::GameSession& game_session) {
+            const model::Map::Id& map_id = game_session.GetMap().GetId();
+            metrics::SessionMetrics& session_metrics = session_metrics_.at(map_id);
+            session_metrics.players.Set(static_cast<int64_t>(players_.GetPlayers(map_id).Size()));
+            session_metrics.loot.Set(static_cast<int64_t>(game_session.GetLootObjects().Size()));
+        }
+
+        // Runs on the application strand and fans the tick out to the strands of the
+        // maps, so sessions of different maps are updated in parallel. The last
+        // session to publish its snapshot calls on_done, so a caller waiting for
+        // it reads every map as of the end of the tick.
+        void Tick(std::chrono::milliseconds delta, std::function<void()> on_done = {}) {
+            AddTime(delta);
+            auto& game_sessions = game_.GetGameSessions();
+            if (game_sessions.empty()) {
+                if (on_done)
+                    on_done();
+                return;
+            }
+            auto pending = std::make_shared<std::atomic<size_t>>(game_sessions.size());
+            for (auto& [map_id, game_session] : game_sessions) {
+                net::post(GetSessionStrand(map_id), [this, &game_session, delta, pending, on_done] {
+                    TickSession(game_session, delta);
+                    if (--*pending == 0 && on_done)
+                        on_done();
+                });
+            }
+        }
+
+        // Runs on the application strand.
+        void AddTime(std::chrono::milliseconds delta) {
+            int msc_in_sec = 1000;
+            game_.AddTime(1.0 * delta.count() / msc_in_sec);
+            const double timer = game_.GetTimer();
+
+            if(!save_path_.empty() && save_period_ != 0 && prev_saving_ < timer * msc_in_sec - save_period_) {
+                SaveState();
+                prev_saving_ = timer * msc_in_sec;
             }
+        }
 
-            collision_detector::OfficeGathererProvider office_provider(game_, players_);
-            std::vector<collision_detector::GatheringEvent> office_events = FindGatherEvents(office_provider);
+        // Every session is captured on its own strand. The last one to finish passes
+        // the assembled state to the application strand to be written, so no strand
+        // ever waits for another one.
+        void SaveState() {
+            auto snapshot = std::make_shared<StateSnapshot>();
+            snapshot->game = model::GameSerializer(game_);
+            snapshot->sessions.resize(game_.GetGameSessions().size());
+            snapshot->pending = snapshot->sessions.size();
 
-            for(const auto& event : office_events) {
-                for(auto& game_session : game_.GetGameSessions()) {
-                    if(game_session.second.GetDogs().size() != players_.GetPlayers()[event.gatherer_id]->GetGameSession().GetDogs().size()) {
-                        continue;
+            size_t index = 0;
+            for (auto& [map_id, game_session] : game_.GetGameSessions()) {
+                net::post(GetSessionStrand(map_id), [this, snapshot, &game_session, index = index++] {
+                    {
+                        model::TickProfiler::Scope scope(&profiler_, model::TickProfiler::Phase::SNAPSHOT);
+                        const auto& players = players_.GetPlayers(game_session.GetMap().GetId());
+                        snapshot->sessions[index] = serializer::SessionSerializer(game_session, players);
                     }
-                    model::Dog& dog = players_.GetPlayers()[event.gatherer_id]->GetDog();
-                    for(auto& loot : dog.ReturnLoot()) {
-                        json::value parsed_game_data = json::parse(game_.GetJsonMap(game_session.second.GetMap().GetId()));
-                        int loot_value = parsed_game_data.as_object()["lootTypes"].as_array()[loot->GetType()].as_object()["value"].as_int64();
-                        players_.GetPlayers()[event.gatherer_id]->AddValue(loot_value);
+                    if (--snapshot->pending == 0) {
+                        net::post(strand_, [this, snapshot] {
+                            model::TickProfiler::Scope scope(&profiler_, model::TickProfiler::Phase::SAVE);
+                            serializer::SerializeGame(save_path_, serializer::ApplicationSerializer(
+                                std::move(snapshot->game), players::TokensSerializer(player_tokens_), std::move(snapshot->sessions)));
+                            std::error_code ec;
+                            const auto size = std::filesystem::file_size(save_path_, ec);
+                            if (!ec)
+                                metrics::GetServerMetrics().snapshot_bytes.Set(static_cast<int64_t>(size));
+                        });
                     }
-                }
-
-                break;
+                });
             }
+        }
 
+        // Runs on the strand of the session's map. The session itself is stepped by
+        // the model; here the outcome is applied to the players and the records.
+        void TickSession(model::GameSession& game_session, std::chrono::milliseconds delta) {
+            model::TickProfiler::Scope session_scope(&profiler_, model::TickProfiler::Phase::SESSION);
+            model::TickPipeline pipeline(game_session, game_.GetRetirementTime(), &profiler_);
+            const model::TickResult result = pipeline.Run(delta);
+            if (!result.retired_dogs.empty() || !result.deposits.empty())
+                ApplyTickResult(game_session, result);
+
+            const model::Map::Id& map_id = game_session.GetMap().GetId();
+            PublishSnapshot(game_session);
+            PushState(map_id);
+            session_metrics_.at(map_id).retired.Inc(result.retired_dogs.size());
+            PublishSessionMetrics(game_session);
         }
 
 	private:
+        struct StateSnapshot {
+            model::GameSerializer game;
+            std::vector<serializer::SessionSerializer> sessions;
+            std::atomic<size_t> pending = 0;
+        };
+        // Commands of a map waiting for its snapshot to be updated. Only touched on
+        // the strand of the map.
+        struct PendingUpdate {
+            bool dirty = false;
+            bool scheduled = false;
+            std::vector<std::function<void()>> waiting;
+        };
+        using MapIdHasher = util::TaggedHasher<model::Map::Id>;
+
+        // The snapshot serializes its state once per encoding, so every subscriber
+        // of an encoding gets the same body.
+        void PushState(const model::Map::Id& map_id) {
+            auto& sinks = subscribers_.at(map_id);
+            if (sinks.Size() == 0)
+                return;
+            sinks.Push(*GetSnapshot(map_id));
+        }
+
+        void ApplyTickResult(model::GameSession& game_session, const model::TickResult& result) {
+            auto& players = players_.GetPlayers(game_session.GetMap().GetId());
+            std::vector<players::Player*> player_of_dog(game_session.GetDogTable().Size(), nullptr);
+            std::vector<players::PlayerHandle> handle_of_dog(game_session.GetDogTable().Size());
+            players.ForEach([&](players::PlayerHandle handle, players::Player& player) {
+                player_of_dog[player.GetDog().GetIndex()] = &player;
+                handle_of_dog[player.GetDog().GetIndex()] = handle;
+            });
+
+            model::TickProfiler::Scope records_scope(&profiler_, model::TickProfiler::Phase::RECORDS);
+            for (size_t dog_index : result.retired_dogs) {
+                players::Player* player = player_of_dog[dog_index];
+                if (!player)
+                    continue;
+
+                const auto& dog = player->GetDog();
+                auto conn = conn_pool_.GetConnection();
+                pqxx::work work{*conn};
+                double total_time = (dog.GetCurrentTime() - dog.GetStartTime());
+                work.exec_params("INSERT INTO retired_players (id, name, score, play_time_ms) VALUES ($1, $2, $3, $4)"_zv, 
+                    dog.GetUUID().ToString(), dog.GetName(), player->GetValue(), total_time);
+                work.commit();
+            }
+
+            for (const auto& deposit : result.deposits) {
+                players::Player* player = player_of_dog[deposit.dog];
+                if (!player)
+                    continue;
+
+                player->AddValue(deposit.value);
+            }
+
+            // Retired players are in the records now, so they are dropped to keep
+            // the per-tick loops to the players still in the game, and so are
+            // their tokens. Their ids are never handed out again. Rows are
+            // removed from the back, so the row moved into a freed slot is never
+            // one that is still to be removed.
+            for (auto it = result.retired_dogs.rbegin(); it != result.retired_dogs.rend(); ++it) {
+                const size_t dog_index = *it;
+                if (const players::Player* player = player_of_dog[dog_index]) {
+                    if (auto token = player_tokens_.FindTokenByPlayer(player->GetId()))
+                        player_tokens_.Remove(*token);
+                }
+                players.Erase(handle_of_dog[dog_index]);
+                const size_t moved_from = game_session.RemoveDog(dog_index);
+                players::Player* moved = player_of_dog[moved_from];
+                if (moved_from != dog_index && moved) {
+                    moved->SetDog(model::Dog(game_session.GetDogTable(), dog_index));
+                    player_of_dog[dog_index] = moved;
+                    handle_of_dog[dog_index] = handle_of_dog[moved_from];
+                }
+            }
+        }
+
+        Strand strand_;
+        std::unordered_map<model::Map::Id, Strand, MapIdHasher> session_strands_;
+        std::unordered_map<model::Map::Id, metrics::SessionMetrics, MapIdHasher> session_metrics_;
+        std::unordered_map<model::Map::Id, std::atomic<game_state::SnapshotPtr>, MapIdHasher> snapshots_;
+        std::unordered_map<model::Map::Id, PendingUpdate, MapIdHasher> updates_;
+        std::unordered_map<model::Map::Id, game_state::StateSubscribers, MapIdHasher> subscribers_;
 		model::Game& game_;
 		players::Players& players_;
         players::PlayerTokens& player_tokens_;
@@ -182,5 +323,6 @@ namespace application {
         int save_period_ = 0;
         int prev_saving_ = 100;
         std::string save_path_;
+        model::TickProfiler profiler_;
 	};
 }
\ No newline at end of file
@@ -1,5 +1,13 @@
 #include "collision_detector.h"
 #include <cassert>
+#include <tuple>
+
+// On x86-64 the collection kernel is built for SSE2 and for AVX2 whatever the
+// target flags, and the wider one is picked at run time if the CPU has it.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define COLLISION_DETECTOR_X86_KERNELS
+#include <immintrin.h>
+#endif
 
 namespace collision_detector {
 
@@ -18,16 +26,255 @@ CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D
     return CollectionResult(sq_distance, proj_ratio);
 }
 
-std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider) {
-    std::vector<GatheringEvent> events;
+#if defined(COLLISION_DETECTOR_X86_KERNELS)
+namespace {
+
+// The kernels compute exactly the same expressions as TryCollectPoint, lane by
+// lane, and only write out the lanes with a hit. Each returns how many items it
+// went through; the rest are left to the scalar loop.
+__attribute__((target("avx2")))
+size_t CollectPointsAvx2(geom::Point2D a, double v_x, double v_y, double v_len2, double gatherer_width, std::span<const double> xs,
+                         std::span<const double> ys, std::span<const double> widths, std::vector<CollectHit>& hits) {
+    const size_t count = xs.size();
+    size_t i = 0;
+    constexpr size_t LANES = 4;
+    const __m256d a_x4 = _mm256_set1_pd(a.x);
+    const __m256d a_y4 = _mm256_set1_pd(a.y);
+    const __m256d v_x4 = _mm256_set1_pd(v_x);
+    const __m256d v_y4 = _mm256_set1_pd(v_y);
+    const __m256d v_len2_4 = _mm256_set1_pd(v_len2);
+    const __m256d width4 = _mm256_set1_pd(gatherer_width);
+    const __m256d zero4 = _mm256_setzero_pd();
+    const __m256d one4 = _mm256_set1_pd(1.0);
+    for(; i + LANES <= count; i += LANES) {
+        const __m256d u_x = _mm256_sub_pd(_mm256_loadu_pd(xs.data() + i), a_x4);
+        const __m256d u_y = _mm256_sub_pd(_mm256_loadu_pd(ys.data() + i), a_y4);
+        const __m256d u_dot_v = _mm256_add_pd(_mm256_mul_pd(u_x, v_x4), _mm256_mul_pd(u_y, v_y4));
+        const __m256d u_len2 = _mm256_add_pd(_mm256_mul_pd(u_x, u_x), _mm256_mul_pd(u_y, u_y));
+        const __m256d proj_ratio = _mm256_div_pd(u_dot_v, v_len2_4);
+        const __m256d sq_distance = _mm256_sub_pd(u_len2, _mm256_div_pd(_mm256_mul_pd(u_dot_v, u_dot_v), v_len2_4));
+        const __m256d radius = _mm256_add_pd(width4, _mm256_loadu_pd(widths.data() + i));
+        const __m256d collected = _mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(proj_ratio, zero4, _CMP_GE_OQ), _mm256_cmp_pd(proj_ratio, one4, _CMP_LE_OQ)),
+            _mm256_cmp_pd(sq_distance, _mm256_mul_pd(radius, radius), _CMP_LE_OQ));
+        int mask = _mm256_movemask_pd(collected);
+        if(mask == 0)
+            continue;
+
+        alignas(32) double proj_ratios[LANES];
+        alignas(32) double sq_distances[LANES];
+        _mm256_store_pd(proj_ratios, proj_ratio);
+        _mm256_store_pd(sq_distances, sq_distance);
+        for(size_t lane = 0; lane < LANES; ++lane) {
+            if(mask & (1 << lane))
+                hits.push_back({i + lane, sq_distances[lane], proj_ratios[lane]});
+        }
+    }
+    return i;
+}
+
+size_t CollectPointsSse2(geom::Point2D a, double v_x, double v_y, double v_len2, double gatherer_width, std::span<const double> xs,
+                         std::span<const double> ys, std::span<const double> widths, std::vector<CollectHit>& hits) {
+    const size_t count = xs.size();
+    size_t i = 0;
+    constexpr size_t LANES = 2;
+    const __m128d a_x2 = _mm_set1_pd(a.x);
+    const __m128d a_y2 = _mm_set1_pd(a.y);
+    const __m128d v_x2 = _mm_set1_pd(v_x);
+    const __m128d v_y2 = _mm_set1_pd(v_y);
+    const __m128d v_len2_2 = _mm_set1_pd(v_len2);
+    const __m128d width2 = _mm_set1_pd(gatherer_width);
+    const __m128d zero2 = _mm_setzero_pd();
+    const __m128d one2 = _mm_set1_pd(1.0);
+    for(; i + LANES <= count; i += LANES) {
+        const __m128d u_x = _mm_sub_pd(_mm_loadu_pd(xs.data() + i), a_x2);
+        const __m128d u_y = _mm_sub_pd(_mm_loadu_pd(ys.data() + i), a_y2);
+        const __m128d u_dot_v = _mm_add_pd(_mm_mul_pd(u_x, v_x2), _mm_mul_pd(u_y, v_y2));
+        const __m128d u_len2 = _mm_add_pd(_mm_mul_pd(u_x, u_x), _mm_mul_pd(u_y, u_y));
+        const __m128d proj_ratio = _mm_div_pd(u_dot_v, v_len2_2);
+        const __m128d sq_distance = _mm_sub_pd(u_len2, _mm_div_pd(_mm_mul_pd(u_dot_v, u_dot_v), v_len2_2));
+        const __m128d radius = _mm_add_pd(width2, _mm_loadu_pd(widths.data() + i));
+        const __m128d collected = _mm_and_pd(
+            _mm_and_pd(_mm_cmpge_pd(proj_ratio, zero2), _mm_cmple_pd(proj_ratio, one2)),
+            _mm_cmple_pd(sq_distance, _mm_mul_pd(radius, radius)));
+        int mask = _mm_movemask_pd(collected);
+        if(mask == 0)
+            continue;
+
+        alignas(16) double proj_ratios[LANES];
+        alignas(16) double sq_distances[LANES];
+        _mm_store_pd(proj_ratios, proj_ratio);
+        _mm_store_pd(sq_distances, sq_distance);
+        for(size_t lane = 0; lane < LANES; ++lane) {
+            if(mask & (1 << lane))
+                hits.push_back({i + lane, sq_distances[lane], proj_ratios[lane]});
+        }
+    }
+    return i;
+}
+
+bool HasAvx2() {
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+}
+
+}  // namespace
+#endif
+
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, double gatherer_width, std::span<const double> xs,
+                      std::span<const double> ys, std::span<const double> widths, std::vector<CollectHit>& hits) {
+    assert(b.x != a.x || b.y != a.y);
+    assert(xs.size() == ys.size() && xs.size() == widths.size());
+    const double v_x = b.x - a.x;
+    const double v_y = b.y - a.y;
+    const double v_len2 = v_x * v_x + v_y * v_y;
+    const size_t count = xs.size();
+    size_t i = 0;
+
+#if defined(COLLISION_DETECTOR_X86_KERNELS)
+    i = HasAvx2() ? CollectPointsAvx2(a, v_x, v_y, v_len2, gatherer_width, xs, ys, widths, hits)
+                  : CollectPointsSse2(a, v_x, v_y, v_len2, gatherer_width, xs, ys, widths, hits);
+#endif
+
+    for(; i < count; ++i) {
+        const double u_x = xs[i] - a.x;
+        const double u_y = ys[i] - a.y;
+        const double u_dot_v = u_x * v_x + u_y * v_y;
+        const double u_len2 = u_x * u_x + u_y * u_y;
+        CollectionResult result{u_len2 - (u_dot_v * u_dot_v) / v_len2, u_dot_v / v_len2};
+        if(result.IsCollected(gatherer_width + widths[i]))
+            hits.push_back({i, result.sq_distance, result.proj_ratio});
+    }
+}
+
+namespace {
+
+// Events at the same time are ordered by item and then by gatherer, so the
+// order is a strict weak one and does not depend on how the events were found.
+void SortByTime(std::vector<GatheringEvent>& events) {
+    std::sort(events.begin(), events.end(), [](const GatheringEvent& left, const GatheringEvent& right) {
+        return std::tie(left.time, left.item_id, left.gatherer_id) < std::tie(right.time, right.item_id, right.gatherer_id);
+    });
+}
+
+}  // namespace
+
+ItemIndex::ItemIndex(std::span<const Item> items) {
+    if(items.empty()) {
+        return;
+    }
+
+    min_x_ = max_x_ = items.front().position.x;
+    min_y_ = max_y_ = items.front().position.y;
+    for(const Item& item : items) {
+        min_x_ = std::min(min_x_, item.position.x);
+        min_y_ = std::min(min_y_, item.position.y);
+        max_x_ = std::max(max_x_, item.position.x);
+        max_y_ = std::max(max_y_, item.position.y);
+        max_width_ = std::max(max_width_, item.width);
+    }
+
+    // Sparse items spread over a large area would make a huge grid, so the
+    // cells grow until there are not many more of them than items.
+    cell_size_ = std::max(1.0, 2 * max_width_);
+    const size_t max_cells = items.size() * 4 + 64;
+    while(CellsAlong(max_x_ - min_x_) * CellsAlong(max_y_ - min_y_) > max_cells) {
+        cell_size_ *= 2;
+    }
+    width_ = CellsAlong(max_x_ - min_x_);
+    height_ = CellsAlong(max_y_ - min_y_);
+
+    std::vector<size_t> item_cells(items.size());
+    cell_offsets_.assign(width_ * height_ + 1, 0);
+    for(size_t i = 0; i < items.size(); ++i) {
+        item_cells[i] = Cell(Column(items[i].position.x), Row(items[i].position.y));
+        ++cell_offsets_[item_cells[i] + 1];
+    }
+    for(size_t cell = 0; cell + 1 < cell_offsets_.size(); ++cell) {
+        cell_offsets_[cell + 1] += cell_offsets_[cell];
+    }
+    item_indices_.resize(items.size());
+    xs_.resize(items.size());
+    ys_.resize(items.size());
+    widths_.resize(items.size());
+    std::vector<size_t> filled(cell_offsets_.begin(), cell_offsets_.end() - 1);
+    for(size_t i = 0; i < items.size(); ++i) {
+        const size_t slot = filled[item_cells[i]]++;
+        item_indices_[slot] = i;
+        xs_[slot] = items[i].position.x;
+        ys_[slot] = items[i].position.y;
+        widths_[slot] = items[i].width;
+    }
+}
 
+void ItemIndex::Collect(const Gatherer& gatherer, std::vector<CollectHit>& hits) const {
+    if(item_indices_.empty()) {
+        return;
+    }
+
+    // Only the items near the swept segment can be collected.
+    const double reach = gatherer.width + max_width_;
+    const geom::Point2D min{std::min(gatherer.start_pos.x, gatherer.end_pos.x) - reach, std::min(gatherer.start_pos.y, gatherer.end_pos.y) - reach};
+    const geom::Point2D max{std::max(gatherer.start_pos.x, gatherer.end_pos.x) + reach, std::max(gatherer.start_pos.y, gatherer.end_pos.y) + reach};
+    if(max.x < min_x_ || max.y < min_y_ || min.x > max_x_ || min.y > max_y_) {
+        return;
+    }
+
+    const size_t first_column = Column(min.x), last_column = Column(max.x);
+    const size_t first_row = Row(min.y), last_row = Row(max.y);
+    for(size_t row = first_row; row <= last_row; ++row) {
+        const size_t begin = cell_offsets_[Cell(first_column, row)];
+        const size_t count = cell_offsets_[Cell(last_column, row) + 1] - begin;
+        const size_t first_hit = hits.size();
+        TryCollectPoints(gatherer.start_pos, gatherer.end_pos, gatherer.width,
+                         std::span(xs_).subspan(begin, count), std::span(ys_).subspan(begin, count),
+                         std::span(widths_).subspan(begin, count), hits);
+        for(size_t hit = first_hit; hit < hits.size(); ++hit) {
+            hits[hit].item = item_indices_[begin + hits[hit].item];
+        }
+    }
+}
+
+size_t ItemIndex::Column(double x) const {
+    return std::min(static_cast<size_t>(std::max(x - min_x_, 0.0) / cell_size_), width_ - 1);
+}
+
+size_t ItemIndex::Row(double y) const {
+    return std::min(static_cast<size_t>(std::max(y - min_y_, 0.0) / cell_size_), height_ - 1);
+}
+
+namespace {
+
+std::vector<Item> CollectItems(const ItemGathererProvider& provider) {
+    std::vector<Item> items;
+    items.reserve(provider.ItemsCount());
+    for(size_t i = 0; i < provider.ItemsCount(); ++i) {
+        items.push_back(provider.GetItem(i));
+    }
+    return items;
+}
+
+std::vector<Gatherer> CollectGatherers(const ItemGathererProvider& provider) {
+    std::vector<Gatherer> gatherers;
+    gatherers.reserve(provider.GatherersCount());
     for(size_t g = 0; g < provider.GatherersCount(); ++g) {
-        Gatherer gatherer = provider.GetGatherer(g);
+        gatherers.push_back(provider.GetGatherer(g));
+    }
+    return gatherers;
+}
+
+}  // namespace
+
+std::vector<GatheringEvent> FindGatherEventsBruteForce(std::span<const Item> items, std::span<const Gatherer> gatherers) {
+    std::vector<GatheringEvent> events;
+
+    for(size_t g = 0; g < gatherers.size(); ++g) {
+        const Gatherer& gatherer = gatherers[g];
         if(gatherer.start_pos == gatherer.end_pos) 
             continue;
         
-        for(size_t i = 0; i < provider.ItemsCount(); ++i) {
-            Item item = provider.GetItem(i);
+        for(size_t i = 0; i < items.size(); ++i) {
+            const Item& item = items[i];
             
             if(CollectionResult result = TryCollectPoint(gatherer.start_pos, gatherer.end_pos, item.position);
                     result.IsCollected(gatherer.width + item.width)) {
@@ -36,12 +283,55 @@ std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provide
         }
     }
 
-    double EPSILON = 1e-5;
-    std::sort(events.begin(), events.end(), [&EPSILON](const GatheringEvent& left, const GatheringEvent& right) {
-        return left.time < right.time - EPSILON;
-    });
+    SortByTime(events);
+    return events;
+}
+
+std::vector<GatheringEvent> FindGatherEvents(std::span<const Item> items, std::span<const Gatherer> gatherers) {
+    // Below this many items bucketing costs more than it saves.
+    constexpr size_t MIN_ITEMS_FOR_GRID = 16;
+    if(items.size() < MIN_ITEMS_FOR_GRID) {
+        return FindGatherEventsBruteForce(items, gatherers);
+    }
 
+    return FindGatherEvents(ItemIndex(items), gatherers);
+}
+
+std::vector<GatheringEvent> FindGatherEvents(const ItemIndex& items, std::span<const Gatherer> gatherers) {
+    std::vector<GatheringEvent> events;
+    std::vector<CollectHit> hits;
+    for(size_t g = 0; g < gatherers.size(); ++g) {
+        const Gatherer& gatherer = gatherers[g];
+        if(gatherer.start_pos == gatherer.end_pos) 
+            continue;
+
+        hits.clear();
+        items.Collect(gatherer, hits);
+        // Hits are reported in item order so that the events come out exactly
+        // as from the brute-force search.
+        std::sort(hits.begin(), hits.end(), [](const CollectHit& lhs, const CollectHit& rhs) {
+            return lhs.item < rhs.item;
+        });
+
+        for(const CollectHit& hit : hits) {
+            events.push_back({hit.item, g, hit.sq_distance, hit.proj_ratio});
+        }
+    }
+
+    SortByTime(events);
     return events;
 }
 
+std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider) {
+    const auto items = CollectItems(provider);
+    const auto gatherers = CollectGatherers(provider);
+    return FindGatherEvents(std::span<const Item>(items), std::span<const Gatherer>(gatherers));
+}
+
+std::vector<GatheringEvent> FindGatherEventsBruteForce(const ItemGathererProvider& provider) {
+    const auto items = CollectItems(provider);
+    const auto gatherers = CollectGatherers(provider);
+    return FindGatherEventsBruteForce(std::span<const Item>(items), std::span<const Gatherer>(gatherers));
+}
+
 }  // namespace collision_detector
\ No newline at end of file
@@ -1,10 +1,10 @@
 #pragma once
 
 #include "geom.h"
-#include "model.h"
-#include "player.h"
 
 #include <algorithm>
+#include <concepts>
+#include <span>
 #include <vector>
 
 namespace collision_detector {
@@ -20,6 +20,18 @@ struct CollectionResult {
 
 CollectionResult TryCollectPoint(geom::Point2D a, geom::Point2D b, geom::Point2D c);
 
+struct CollectHit {
+    size_t item;
+    double sq_distance;
+    double proj_ratio;
+};
+
+// Tries a batch of items, given as parallel arrays, against the segment a-b of
+// one gatherer and appends the items it collects, in order. On x86-64 it uses
+// AVX2 when the CPU has it and SSE2 otherwise; other targets get plain code.
+void TryCollectPoints(geom::Point2D a, geom::Point2D b, double gatherer_width, std::span<const double> xs,
+                      std::span<const double> ys, std::span<const double> widths, std::vector<CollectHit>& hits);
+
 struct Item {
     Item(geom::Point2D position, double width) 
         : position{position}
@@ -44,6 +56,16 @@ struct Gatherer {
     double width;
 };
 
+// Providers expose their items and gatherers as contiguous arrays, so the
+// search reads them directly instead of calling a getter per pair.
+template <typename Provider>
+concept GathererProvider = requires(const Provider& provider) {
+    { provider.GetItems() } -> std::convertible_to<std::span<const Item>>;
+    { provider.GetGatherers() } -> std::convertible_to<std::span<const Gatherer>>;
+};
+
+// Index based interface, still accepted by FindGatherEvents for providers that
+// build their items on the fly, like the ones in the tests.
 class ItemGathererProvider {
 protected:
     ~ItemGathererProvider() = default;
@@ -62,78 +84,60 @@ struct GatheringEvent {
     double time;
 };
 
-class LootGathererProvider : public ItemGathererProvider {
+// Broad phase over items: they are bucketed by the cells of a uniform grid over
+// their bounding box, and the coordinates and widths are stored cell by cell in
+// parallel arrays, so the items of a row of cells are contiguous and go to the
+// collection kernel as is. Items that never move, like offices, are indexed once.
+class ItemIndex {
 public:
-    LootGathererProvider(model::Game& game, players::Players& players) 
-        : game_(game)
-        , players_(players)
-        {
-        }
+    ItemIndex() = default;
+    explicit ItemIndex(std::span<const Item> items);
 
-    size_t ItemsCount() const override {
-        return game_.GetLootObjects().size();
-    }
-    Item GetItem(size_t idx) const override {
-        
-        auto& position = game_.GetLootObjects()[idx]->GetPosition();
-        double width = 0.0;
-        return Item({position.x, position.y}, width);
-    }
-    size_t GatherersCount() const override {
-        return players_.GetPlayers().size();
-    }
-    Gatherer GetGatherer(size_t idx) const override {
-        const auto& end = players_.GetPlayers().at(idx)->GetDog().GetPosition();
-        const auto& start = players_.GetPlayers().at(idx)->GetDog().GetStartPosition();
-        double width = 0.6;
-        return Gatherer({start.x, start.y}, {end.x, end.y}, width);
+    size_t Size() const noexcept {
+        return item_indices_.size();
     }
 
+    // Appends the hits of the gatherer among the items near its segment, with
+    // item ids as given to the index.
+    void Collect(const Gatherer& gatherer, std::vector<CollectHit>& hits) const;
+
 private:
-    model::Game& game_;
-    players::Players& players_;
-};
+    size_t CellsAlong(double extent) const {
+        return static_cast<size_t>(extent / cell_size_) + 1;
+    }
 
-class OfficeGathererProvider : public ItemGathererProvider {
-public:
-    OfficeGathererProvider(model::Game game, players::Players& players) 
-        : game_(game)
-        , players_(players)
-        {
-        }
+    size_t Column(double x) const;
+    size_t Row(double y) const;
 
-    size_t ItemsCount() const override {
-        size_t items_counter = 0;
-        for(auto& map : game_.GetMaps()) {
-            items_counter += map.GetOffices().size();
-        }
-        return items_counter;
-    }
-    Item GetItem(size_t idx) const override {
-        for(auto& map : game_.GetMaps()) {
-            if(idx < map.GetOffices().size()) {
-                const auto& position = map.GetOffices()[idx].GetPosition();
-                double offices_width = 0.5;
-                return Item{{position.x * 1.0, position.y * 1.0}, offices_width};
-            }
-            idx -= map.GetOffices().size();
-        }
-        return Item{{0.0, 0.0}, 0.0};
+    size_t Cell(size_t column, size_t row) const {
+        return row * width_ + column;
     }
-    size_t GatherersCount() const override {
-        return players_.GetPlayers().size();
-    }
-    Gatherer GetGatherer(size_t idx) const override {
-        const auto& end = players_.GetPlayers().at(idx)->GetDog().GetPosition();
-        const auto& start = players_.GetPlayers().at(idx)->GetDog().GetStartPosition();
-        double width = 0.6;
-        return Gatherer({start.x, start.y}, {end.x, end.y}, width);
-    }
-private:
-    model::Game& game_;
-    players::Players& players_;
+
+    double cell_size_ = 1.0;
+    double max_width_ = 0.0;
+    double min_x_ = 0.0, min_y_ = 0.0, max_x_ = 0.0, max_y_ = 0.0;
+    size_t width_ = 0, height_ = 0;
+    std::vector<size_t> cell_offsets_;
+    std::vector<size_t> item_indices_;
+    std::vector<double> xs_;
+    std::vector<double> ys_;
+    std::vector<double> widths_;
 };
 
+// Buckets the items into a uniform grid and only tries the items near the
+// segment of each gatherer.
+std::vector<GatheringEvent> FindGatherEvents(std::span<const Item> items, std::span<const Gatherer> gatherers);
+std::vector<GatheringEvent> FindGatherEvents(const ItemIndex& items, std::span<const Gatherer> gatherers);
 std::vector<GatheringEvent> FindGatherEvents(const ItemGathererProvider& provider);
 
+template <GathererProvider Provider>
+std::vector<GatheringEvent> FindGatherEvents(const Provider& provider) {
+    return FindGatherEvents(std::span<const Item>(provider.GetItems()), std::span<const Gatherer>(provider.GetGatherers()));
+}
+
+// Tries every gatherer against every item. Kept as the reference the grid
+// search is checked against.
+std::vector<GatheringEvent> FindGatherEventsBruteForce(std::span<const Item> items, std::span<const Gatherer> gatherers);
+std::vector<GatheringEvent> FindGatherEventsBruteForce(const ItemGathererProvider& provider);
+
 }  // namespace collision_detector
\ No newline at end of file
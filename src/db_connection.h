@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <iostream>
 
 #include <pqxx/pqxx>
 
+#include "metrics.h"
+
 using namespace std::literals;
 using pqxx::operator"" _zv;
 
@@ -70,12 +73,17 @@ play_time_ms float4);
     }
 
     ConnectionWrapper GetConnection() {
+        const auto start = std::chrono::steady_clock::now();
         std::unique_lock lock{mutex_};
         cond_var_.wait(lock, [this] {
             return used_connections_ < pool_.size();
         });
+        ConnectionPtr conn = std::move(pool_[used_connections_++]);
+        lock.unlock();
 
-        return {std::move(pool_[used_connections_++]), *this};
+        const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        metrics::GetServerMetrics().connection_wait.Record(static_cast<uint64_t>(wait.count()));
+        return {std::move(conn), *this};
     }
 
 private:
@@ -0,0 +1,328 @@
+#include "game_state.h"
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <map>
+#include <optional>
+
+namespace game_state {
+
+    namespace json = boost::json;
+    using namespace std::literals;
+
+    namespace {
+
+        bool SameState(const PlayerState& lhs, const PlayerState& rhs) {
+            return lhs.pos.x == rhs.pos.x && lhs.pos.y == rhs.pos.y
+                && lhs.speed.x == rhs.speed.x && lhs.speed.y == rhs.speed.y
+                && lhs.dir == rhs.dir && lhs.score == rhs.score && lhs.name == rhs.name
+                && std::equal(lhs.bag.begin(), lhs.bag.end(), rhs.bag.begin(), rhs.bag.end(), [](const BagItemState& l, const BagItemState& r) {
+                    return l.id == r.id && l.type == r.type;
+                });
+        }
+
+        bool SameState(const LootState& lhs, const LootState& rhs) {
+            return lhs.type == rhs.type && lhs.pos.x == rhs.pos.x && lhs.pos.y == rhs.pos.y;
+        }
+
+        // Walks two lists ordered by id and collects the entities that are new or
+        // differ in the second one and the ids that are only in the first one.
+        template <typename State>
+        void Diff(const std::vector<State>& before, const std::vector<State>& after, std::vector<State>& changed, std::vector<int>& removed) {
+            auto old_it = before.begin();
+            for (const State& state : after) {
+                while (old_it != before.end() && old_it->id < state.id) {
+                    removed.push_back((old_it++)->id);
+                }
+                if (old_it != before.end() && old_it->id == state.id) {
+                    if (!SameState(*old_it, state)) {
+                        changed.push_back(state);
+                    }
+                    ++old_it;
+                } else {
+                    changed.push_back(state);
+                }
+            }
+            for (; old_it != before.end(); ++old_it) {
+                removed.push_back(old_it->id);
+            }
+        }
+
+        // Applies the changes of a change set over those of the earlier ones: the
+        // last state of an entity wins, and a removal is kept unless it comes back.
+        template <typename State>
+        void Merge(std::map<int, std::optional<State>>& merged, const std::vector<State>& changed, const std::vector<int>& removed) {
+            for (int id : removed) {
+                merged[id] = std::nullopt;
+            }
+            for (const State& state : changed) {
+                merged[state.id] = state;
+            }
+        }
+
+        template <typename State>
+        void Split(const std::map<int, std::optional<State>>& merged, std::vector<State>& changed, std::vector<int>& removed) {
+            for (const auto& [id, state] : merged) {
+                if (state) {
+                    changed.push_back(*state);
+                } else {
+                    removed.push_back(id);
+                }
+            }
+        }
+
+        json::array PointToJson(double x, double y) {
+            json::array point;
+            point.push_back(json::value(x));
+            point.push_back(json::value(y));
+            return point;
+        }
+
+        json::object PlayerToJson(const PlayerState& player) {
+            json::object json_player;
+            json_player["pos"s] = PointToJson(player.pos.x, player.pos.y);
+            json_player["speed"s] = PointToJson(player.speed.x, player.speed.y);
+            json_player["dir"s] = player.dir;
+
+            json::array loot_in_bag;
+            for (const auto& loot : player.bag) {
+                json::object loot_info;
+                loot_info["id"] = loot.id;
+                loot_info["type"] = loot.type;
+                loot_in_bag.push_back(loot_info);
+            }
+            json_player["bag"] = loot_in_bag;
+            json_player["score"] = player.score;
+            return json_player;
+        }
+
+        json::object LootToJson(const LootState& loot) {
+            json::object json_loot;
+            json_loot["type"] = json::value(loot.type);
+            json_loot["pos"s] = PointToJson(loot.pos.x, loot.pos.y);
+            return json_loot;
+        }
+
+        json::object PlayersToJson(const std::vector<PlayerState>& players) {
+            json::object json_info;
+            for (const auto& player : players) {
+                json_info[std::to_string(player.id)] = PlayerToJson(player);
+            }
+            return json_info;
+        }
+
+        json::object LootToJson(const std::vector<LootState>& loot) {
+            json::object json_loot;
+            for (const auto& loot_state : loot) {
+                json_loot[std::to_string(loot_state.id)] = LootToJson(loot_state);
+            }
+            return json_loot;
+        }
+
+        json::array IdsToJson(const std::vector<int>& ids) {
+            json::array json_ids;
+            for (int id : ids) {
+                json_ids.push_back(id);
+            }
+            return json_ids;
+        }
+
+        StateBody MakeDeltaBody(Encoding encoding, uint64_t tick, const std::vector<PlayerState>& players, const std::vector<int>& removed_players,
+                                const std::vector<LootState>& loot, const std::vector<int>& removed_loot) {
+            if (encoding == Encoding::BINARY) {
+                auto body = std::make_shared<std::string>();
+                binary::Encode(*body, tick, false, players, removed_players, loot, removed_loot);
+                return body;
+            }
+
+            json::object json_response;
+            json_response["tick"s] = tick;
+            json_response["full"s] = false;
+            json_response["players"s] = PlayersToJson(players);
+            json_response["removedPlayers"s] = IdsToJson(removed_players);
+            json_response["lostObjects"s] = LootToJson(loot);
+            json_response["removedLostObjects"s] = IdsToJson(removed_loot);
+            return std::make_shared<const std::string>(json::serialize(json_response));
+        }
+
+    }  // namespace
+
+    const StateBody& ChangeSet::GetBody(Encoding encoding) const {
+        const auto index = static_cast<size_t>(encoding);
+        std::call_once(body_once_[index], [this, encoding, index] {
+            body_[index] = MakeDeltaBody(encoding, tick_, players_, removed_players_, loot_, removed_loot_);
+        });
+        return body_[index];
+    }
+
+    void WorldSnapshot::Fill(const model::GameSession& game_session, const players::Players::SessionPlayers& players) {
+        players_.reserve(players.Size());
+        for (const auto& player : players) {
+            const model::Dog& dog = player.GetDog();
+            PlayerState& state = players_.emplace_back();
+            state.id = player.GetId();
+            state.name = player.GetName();
+            state.pos = dog.GetPosition();
+            state.speed = dog.GetSpeed();
+            state.dir = dog.GetDirection();
+            state.bag.reserve(dog.GetBag().size());
+            for (const auto& loot : dog.GetBag()) {
+                state.bag.push_back({loot.GetId(), loot.GetType()});
+            }
+            state.score = player.GetValue();
+            state.online = player.IsOnline();
+        }
+        std::sort(players_.begin(), players_.end(), [](const PlayerState& lhs, const PlayerState& rhs) {
+            return lhs.id < rhs.id;
+        });
+
+        const auto& loot_objects = game_session.GetLootObjects();
+        loot_.reserve(loot_objects.Size());
+        for (const auto& loot_object : loot_objects) {
+            loot_.push_back({loot_object.GetId(), loot_object.GetType(), loot_object.GetPosition()});
+        }
+        std::sort(loot_.begin(), loot_.end(), [](const LootState& lhs, const LootState& rhs) {
+            return lhs.id < rhs.id;
+        });
+    }
+
+    SnapshotPtr WorldSnapshot::CaptureTick(const model::GameSession& game_session, const players::Players::SessionPlayers& players,
+                                           const SnapshotPtr& previous) {
+        auto snapshot = std::make_shared<WorldSnapshot>();
+        snapshot->Fill(game_session, players);
+        if (!previous) {
+            return snapshot;
+        }
+
+        // Clients may hold the snapshot of the previous tick or any update of it,
+        // so the changes of the tick are taken against the snapshot of the tick.
+        // They then also cover what the updates changed.
+        const WorldSnapshot& before = previous->tick_snapshot_ ? *previous->tick_snapshot_ : *previous;
+        snapshot->tick_ = before.tick_ + 1;
+        auto changes = std::make_shared<ChangeSet>();
+        changes->tick_ = snapshot->tick_;
+        Diff(before.players_, snapshot->players_, changes->players_, changes->removed_players_);
+        Diff(before.loot_, snapshot->loot_, changes->loot_, changes->removed_loot_);
+
+        const auto& history = before.history_;
+        const size_t kept = std::min(history.size(), HISTORY_SIZE - 1);
+        snapshot->history_.reserve(kept + 1);
+        snapshot->history_.assign(history.end() - kept, history.end());
+        snapshot->history_.push_back(std::move(changes));
+        return snapshot;
+    }
+
+    SnapshotPtr WorldSnapshot::CaptureUpdate(const model::GameSession& game_session, const players::Players::SessionPlayers& players,
+                                             const SnapshotPtr& previous) {
+        if (!previous) {
+            return CaptureTick(game_session, players, previous);
+        }
+
+        auto snapshot = std::make_shared<WorldSnapshot>();
+        snapshot->Fill(game_session, players);
+        snapshot->tick_snapshot_ = previous->tick_snapshot_ ? previous->tick_snapshot_ : previous;
+        const WorldSnapshot& before = *snapshot->tick_snapshot_;
+        snapshot->tick_ = before.tick_;
+        snapshot->history_ = before.history_;
+        auto changes = std::make_shared<ChangeSet>();
+        changes->tick_ = snapshot->tick_;
+        Diff(before.players_, snapshot->players_, changes->players_, changes->removed_players_);
+        Diff(before.loot_, snapshot->loot_, changes->loot_, changes->removed_loot_);
+        snapshot->update_ = std::move(changes);
+        return snapshot;
+    }
+
+    const PlayerState* WorldSnapshot::FindPlayer(int id) const noexcept {
+        auto it = std::lower_bound(players_.begin(), players_.end(), id, [](const PlayerState& player, int id) {
+            return player.id < id;
+        });
+        return it != players_.end() && it->id == id ? &*it : nullptr;
+    }
+
+    const StateBody& WorldSnapshot::GetStateBody(Encoding encoding) const {
+        if (encoding == Encoding::BINARY) {
+            return GetFullStateBody(encoding);
+        }
+        std::call_once(state_body_once_, [this] {
+            json::object json_response;
+            json_response["players"s] = PlayersToJson(players_);
+            json_response["lostObjects"s] = LootToJson(loot_);
+            state_body_ = std::make_shared<const std::string>(json::serialize(json_response));
+        });
+        return state_body_;
+    }
+
+    StateBody WorldSnapshot::GetStateBodySince(uint64_t since, Encoding encoding) const {
+        if (since > tick_ || tick_ - since > history_.size()) {
+            return GetFullStateBody(encoding);
+        }
+
+        // Most clients poll every tick, so they share the body of a single change set.
+        const size_t behind = tick_ - since;
+        if (behind == 0) {
+            return update_ ? update_->GetBody(encoding) : MakeDeltaBody(encoding, tick_, {}, {}, {}, {});
+        }
+        if (behind == 1 && !update_) {
+            return history_.back()->GetBody(encoding);
+        }
+
+        std::map<int, std::optional<PlayerState>> players;
+        std::map<int, std::optional<LootState>> loot;
+        for (auto it = history_.end() - behind; it != history_.end(); ++it) {
+            Merge(players, (*it)->players_, (*it)->removed_players_);
+            Merge(loot, (*it)->loot_, (*it)->removed_loot_);
+        }
+        if (update_) {
+            Merge(players, update_->players_, update_->removed_players_);
+            Merge(loot, update_->loot_, update_->removed_loot_);
+        }
+        std::vector<PlayerState> changed_players;
+        std::vector<int> removed_players;
+        std::vector<LootState> changed_loot;
+        std::vector<int> removed_loot;
+        Split(players, changed_players, removed_players);
+        Split(loot, changed_loot, removed_loot);
+        return MakeDeltaBody(encoding, tick_, changed_players, removed_players, changed_loot, removed_loot);
+    }
+
+    const StateBody& WorldSnapshot::GetFullStateBody(Encoding encoding) const {
+        const auto index = static_cast<size_t>(encoding);
+        std::call_once(full_body_once_[index], [this, encoding, index] {
+            if (encoding == Encoding::BINARY) {
+                auto body = std::make_shared<std::string>();
+                binary::Encode(*body, tick_, true, players_, {}, loot_, {});
+                full_body_[index] = std::move(body);
+                return;
+            }
+
+            json::object json_response;
+            json_response["tick"s] = tick_;
+            json_response["full"s] = true;
+            json_response["players"s] = PlayersToJson(players_);
+            json_response["lostObjects"s] = LootToJson(loot_);
+            full_body_[index] = std::make_shared<const std::string>(json::serialize(json_response));
+        });
+        return full_body_[index];
+    }
+
+    const StateBody& WorldSnapshot::GetPlayersBody() const {
+        std::call_once(players_body_once_, [this] {
+            json::object json_response;
+            json::object json_player;
+            for (const auto& player : players_) {
+                json_player["name"s] = player.name;
+                json_response[std::to_string(player.id)] = json_player;
+            }
+            players_body_ = std::make_shared<const std::string>(json::serialize(json_response));
+        });
+        return players_body_;
+    }
+
+    void StateSubscribers::Push(const WorldSnapshot& snapshot) {
+        sinks_.erase(std::remove_if(sinks_.begin(), sinks_.end(), [&snapshot](const Sink& sink) {
+            return !sink(snapshot);
+        }), sinks_.end());
+    }
+
+} // namespace game_state
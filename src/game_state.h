@@ -0,0 +1,171 @@
+#pragma once
+
+#include "model.h"
+#include "player.h"
+#include "state_encoding.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace game_state {
+
+    // Serialized body of a response. It is shared by every reader of a snapshot,
+    // so it is never modified once built.
+    using StateBody = std::shared_ptr<const std::string>;
+
+    // How a state body is written: as JSON or in the binary form of
+    // state_encoding.h. Each snapshot builds a body at most once per encoding.
+    enum class Encoding {
+        JSON,
+        BINARY,
+    };
+
+    constexpr size_t ENCODING_COUNT = 2;
+
+    // What changed on a map between two snapshots: the players and the loot that
+    // were added or changed, with their new state, and the ids of those that are
+    // gone. Each list is ordered by id.
+    class ChangeSet {
+    public:
+        uint64_t GetTick() const noexcept {
+            return tick_;
+        }
+
+        // Body of the changes as of the given tick.
+        const StateBody& GetBody(Encoding encoding) const;
+
+    private:
+        friend class WorldSnapshot;
+
+        uint64_t tick_ = 0;
+        std::vector<PlayerState> players_;
+        std::vector<int> removed_players_;
+        std::vector<LootState> loot_;
+        std::vector<int> removed_loot_;
+
+        mutable std::array<std::once_flag, ENCODING_COUNT> body_once_;
+        mutable std::array<StateBody, ENCODING_COUNT> body_;
+    };
+
+    // What the players of a map can see of it at one moment: the players that are
+    // still in the game and the loot lying on the map, both ordered by id. A
+    // snapshot never changes once captured, so any thread may read it without
+    // locking; the response bodies are built by the first reader that needs them.
+    //
+    // Snapshots are numbered by the ticks of the map and carry the change sets of
+    // the last HISTORY_SIZE ticks, so a client that has seen a recent tick only
+    // gets what changed since. Commands between two ticks publish an update of
+    // the snapshot of the last tick: it keeps the tick and the history, and
+    // holds what the commands changed since that snapshot.
+    class WorldSnapshot {
+    public:
+        constexpr static size_t HISTORY_SIZE = 128;
+
+        // Runs on the strand of the session's map at the end of a tick. The new
+        // snapshot is one tick after the previous one, and its change set is
+        // taken against the snapshot of the previous tick. Without a previous
+        // snapshot it is tick 0.
+        static std::shared_ptr<const WorldSnapshot> CaptureTick(const model::GameSession& game_session, const players::Players::SessionPlayers& players,
+                                                                const std::shared_ptr<const WorldSnapshot>& previous);
+
+        // Runs on the strand of the session's map after commands between ticks.
+        static std::shared_ptr<const WorldSnapshot> CaptureUpdate(const model::GameSession& game_session, const players::Players::SessionPlayers& players,
+                                                                  const std::shared_ptr<const WorldSnapshot>& previous);
+
+        uint64_t GetTick() const noexcept {
+            return tick_;
+        }
+
+        const std::vector<PlayerState>& GetPlayers() const noexcept {
+            return players_;
+        }
+
+        const std::vector<LootState>& GetLoot() const noexcept {
+            return loot_;
+        }
+
+        // Returns nullptr if the player is not in the game.
+        const PlayerState* FindPlayer(int id) const noexcept;
+
+        // Body of /game/state: the players and the loot. In binary it is the same
+        // as the full state.
+        const StateBody& GetStateBody(Encoding encoding) const;
+
+        // The whole state with its tick, marked as full.
+        const StateBody& GetFullStateBody(Encoding encoding) const;
+
+        // Body of /game/state?since=<tick>: what changed after the given tick, or
+        // the full state when that tick is no longer in the history.
+        StateBody GetStateBodySince(uint64_t since, Encoding encoding) const;
+
+        // Body of /game/players: the names of the players.
+        const StateBody& GetPlayersBody() const;
+
+    private:
+        void Fill(const model::GameSession& game_session, const players::Players::SessionPlayers& players);
+
+        uint64_t tick_ = 0;
+        std::vector<PlayerState> players_;
+        std::vector<LootState> loot_;
+        // Change sets of ticks tick_ - history_.size() + 1 ... tick_.
+        std::vector<std::shared_ptr<const ChangeSet>> history_;
+        // Set on updates: the snapshot of tick_ and what changed since it.
+        std::shared_ptr<const WorldSnapshot> tick_snapshot_;
+        std::shared_ptr<const ChangeSet> update_;
+
+        mutable std::once_flag state_body_once_;
+        mutable StateBody state_body_;
+        mutable std::array<std::once_flag, ENCODING_COUNT> full_body_once_;
+        mutable std::array<StateBody, ENCODING_COUNT> full_body_;
+        mutable std::once_flag players_body_once_;
+        mutable StateBody players_body_;
+    };
+
+    using SnapshotPtr = std::shared_ptr<const WorldSnapshot>;
+
+    // Receivers of the state of one map, such as the stream connections of its
+    // players. Used on the strand of the map.
+    class StateSubscribers {
+    public:
+        // Gets the state of the map. Returns false once the receiver is closed or
+        // gone, which unsubscribes it.
+        using Sink = std::function<bool(const WorldSnapshot& snapshot)>;
+
+        void Add(Sink sink) {
+            sinks_.push_back(std::move(sink));
+        }
+
+        // Hands the snapshot to every sink and drops the ones that refuse it.
+        void Push(const WorldSnapshot& snapshot);
+
+        size_t Size() const noexcept {
+            return sinks_.size();
+        }
+
+    private:
+        std::vector<Sink> sinks_;
+    };
+
+    // Sink that sends the full state of each snapshot to a stream connection for
+    // as long as it is open. The connection may be anything with IsOpen() and
+    // Send(frame, droppable, binary), like http_server::WebSocketSession. Frames
+    // are sent as droppable: each one holds the whole state, so a slow reader
+    // only needs the latest.
+    template <typename Connection>
+    StateSubscribers::Sink MakeStreamSink(std::weak_ptr<Connection> connection, Encoding encoding) {
+        return [connection = std::move(connection), encoding](const WorldSnapshot& snapshot) {
+            const auto locked = connection.lock();
+            if (!locked || !locked->IsOpen()) {
+                return false;
+            }
+            locked->Send(snapshot.GetFullStateBody(encoding), true, encoding == Encoding::BINARY);
+            return true;
+        };
+    }
+
+} // namespace game_state
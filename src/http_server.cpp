@@ -2,6 +2,9 @@
 #include "http_server.h"
 
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/post.hpp>
+
+#include <algorithm>
 #include <iostream>
 
 using namespace std::literals;
@@ -54,5 +57,85 @@ namespace http_server {
     void SessionBase::Close() {
         stream_.socket().shutdown(tcp::socket::shutdown_send);
     }
+
+    void WebSocketSession::Run(http::request<http::string_body>&& request) {
+        request_ = std::move(request);
+        // The HTTP read timeout no longer applies; the WebSocket pings idle peers.
+        beast::get_lowest_layer(ws_).expires_never();
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+        ws_.async_accept(request_, beast::bind_front_handler(&WebSocketSession::OnAccept, shared_from_this()));
+    }
+
+    void WebSocketSession::Send(Frame frame, bool droppable, bool binary) {
+        net::post(ws_.get_executor(), [self = shared_from_this(), pending = PendingFrame{std::move(frame), droppable, binary}]() mutable {
+            self->Enqueue(std::move(pending));
+        });
+    }
+
+    void WebSocketSession::OnAccept(beast::error_code ec) {
+        if (ec) {
+            closed_ = true;
+            return ReportError(ec, "websocket accept"sv);
+        }
+        accepted_ = true;
+        request_ = {};
+        Read();
+        Write();
+    }
+
+    void WebSocketSession::Read() {
+        ws_.async_read(buffer_, beast::bind_front_handler(&WebSocketSession::OnRead, shared_from_this()));
+    }
+
+    void WebSocketSession::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
+        if (ec) {
+            closed_ = true;
+            queue_.clear();
+            if (ec != websocket::error::closed) {
+                ReportError(ec, "websocket read"sv);
+            }
+            return;
+        }
+        std::string message = beast::buffers_to_string(buffer_.data());
+        buffer_.consume(buffer_.size());
+        on_message_(*this, std::move(message));
+        Read();
+    }
+
+    void WebSocketSession::Enqueue(PendingFrame pending) {
+        if (closed_) {
+            return;
+        }
+        if (pending.droppable) {
+            // The frame being written stays at the front until it is done.
+            const auto waiting = queue_.begin() + (writing_ ? 1 : 0);
+            queue_.erase(std::remove_if(waiting, queue_.end(), [](const PendingFrame& frame) {
+                return frame.droppable;
+            }), queue_.end());
+        }
+        queue_.push_back(std::move(pending));
+        Write();
+    }
+
+    void WebSocketSession::Write() {
+        if (!accepted_ || writing_ || closed_ || queue_.empty()) {
+            return;
+        }
+        writing_ = true;
+        ws_.binary(queue_.front().binary);
+        const Frame& frame = queue_.front().frame;
+        ws_.async_write(net::buffer(*frame), beast::bind_front_handler(&WebSocketSession::OnWrite, shared_from_this()));
+    }
+
+    void WebSocketSession::OnWrite(beast::error_code ec, [[maybe_unused]] std::size_t bytes_written) {
+        writing_ = false;
+        if (ec) {
+            closed_ = true;
+            queue_.clear();
+            return ReportError(ec, "websocket write"sv);
+        }
+        queue_.pop_front();
+        Write();
+    }
     
 }  // namespace http_server
\ No newline at end of file
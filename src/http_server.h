@@ -1,5 +1,6 @@
 #pragma once
 
+#include "metrics.h"
 #include "sdk.h"
 
 #define BOOST_BEAST_USE_STD_STRING_VIEW
@@ -10,6 +11,13 @@
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
 
 
 namespace http_server {
@@ -18,10 +26,68 @@ namespace http_server {
     using tcp = net::ip::tcp;
     namespace beast = boost::beast;
     namespace http = beast::http;
+    namespace websocket = beast::websocket;
     namespace sys = boost::system;
 
     void ReportError(beast::error_code ec, std::string_view what);
 
+    // Connection taken over from an HTTP session by a WebSocket upgrade. Text
+    // messages from the client go to the message handler; frames to the client
+    // are written one at a time in the order they were sent.
+    //
+    // A frame sent as droppable replaces the droppable frames that still wait
+    // behind the one being written, so a slow reader skips stale frames instead
+    // of piling them up.
+    class WebSocketSession : public std::enable_shared_from_this<WebSocketSession> {
+    public:
+        using Frame = std::shared_ptr<const std::string>;
+        // Called on the strand of the connection.
+        using MessageHandler = std::function<void(WebSocketSession& session, std::string message)>;
+
+        WebSocketSession(beast::tcp_stream&& stream, MessageHandler on_message)
+            : ws_(std::move(stream))
+            , on_message_(std::move(on_message)) {
+        }
+
+        WebSocketSession(const WebSocketSession&) = delete;
+        WebSocketSession& operator=(const WebSocketSession&) = delete;
+
+        // Answers the upgrade request and starts reading messages.
+        void Run(http::request<http::string_body>&& request);
+
+        // May be called from any thread.
+        void Send(Frame frame, bool droppable, bool binary = false);
+
+        // May be called from any thread. A closed connection drops every frame
+        // sent to it, so senders should stop once this turns false.
+        bool IsOpen() const noexcept {
+            return !closed_.load(std::memory_order_acquire);
+        }
+
+    private:
+        struct PendingFrame {
+            Frame frame;
+            bool droppable;
+            bool binary;
+        };
+
+        void OnAccept(beast::error_code ec);
+        void Read();
+        void OnRead(beast::error_code ec, std::size_t bytes_read);
+        void Enqueue(PendingFrame pending);
+        void Write();
+        void OnWrite(beast::error_code ec, std::size_t bytes_written);
+
+        websocket::stream<beast::tcp_stream> ws_;
+        MessageHandler on_message_;
+        http::request<http::string_body> request_;
+        beast::flat_buffer buffer_;
+        std::deque<PendingFrame> queue_;
+        bool accepted_ = false;
+        bool writing_ = false;
+        std::atomic<bool> closed_ = false;
+    };
+
     class SessionBase {
     public:
 
@@ -34,10 +100,35 @@ namespace http_server {
 
         explicit SessionBase(tcp::socket&& socket)
             : stream_(std::move(socket)) {
+            metrics::GetServerMetrics().http_sessions.Add(1);
         }
 
         using HttpRequest = http::request<http::string_body>;
 
+        // Passed to the request handler to answer a request. Instead of a response
+        // the handler may turn the connection into a WebSocket session; the HTTP
+        // session then reads no more requests.
+        class Responder {
+        public:
+            explicit Responder(std::shared_ptr<SessionBase> session)
+                : session_(std::move(session)) {
+            }
+
+            template <typename Response>
+            void operator()(Response&& response) const {
+                session_->Write(std::move(response));
+            }
+
+            std::shared_ptr<WebSocketSession> AcceptWebSocket(HttpRequest&& request, WebSocketSession::MessageHandler on_message) const {
+                auto ws = std::make_shared<WebSocketSession>(std::move(session_->stream_), std::move(on_message));
+                ws->Run(std::move(request));
+                return ws;
+            }
+
+        private:
+            std::shared_ptr<SessionBase> session_;
+        };
+
         template <typename Body, typename Fields>
         void Write(http::response<Body, Fields>&& response) {
             auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
@@ -55,7 +146,9 @@ namespace http_server {
         }
 
     public:
-        virtual ~SessionBase() = default;
+        virtual ~SessionBase() {
+            metrics::GetServerMetrics().http_sessions.Add(-1);
+        }
 
     private:
         beast::tcp_stream stream_;
@@ -96,9 +189,7 @@ namespace http_server {
         }
 
         void HandleRequest(HttpRequest&& request) override {
-            request_handler_(GetStream().socket().local_endpoint(), std::move(request), [self = this->shared_from_this()](auto&& response) {
-                self->Write(std::move(response));
-                });
+            request_handler_(GetStream().socket().local_endpoint(), std::move(request), Responder(this->shared_from_this()));
         }
     };
 
@@ -24,16 +24,6 @@ void LoadRoad(json::value& road, model::Map& map_object) {
 		int y0 = road.as_object().at(Y0).as_int64();
 		int x1 = road.as_object().at(X1).as_int64();
 		model::Road road_object(model::Road::HORIZONTAL, { x0, y0 }, x1);
-
-		while (x0 <= x1) {
-			map_object.AddRoadMap({ x0, y0 }, road_object);
-			++x0;
-		}
-		while (x1 <= x0) {
-			map_object.AddRoadMap({ x1, y0 }, road_object);
-			++x1;
-		}
-
 		map_object.AddRoad(road_object);
 	}
 	if (road.as_object().if_contains(Y1)) {
@@ -42,16 +32,6 @@ void LoadRoad(json::value& road, model::Map& map_object) {
 		int y1 = road.as_object().at(Y1).as_int64();
 
 		model::Road road_object(model::Road::VERTICAL, { x0, y0 }, y1);
-
-		while (y0 <= y1) {
-			map_object.AddRoadMap({ x0, y0 }, road_object);
-			++y0;
-		}
-		while (y1 <= y0) {
-			map_object.AddRoadMap({ x0, y1 }, road_object);
-			++y1;
-		}
-
 		map_object.AddRoad(road_object);
 	}
 }
@@ -77,21 +57,48 @@ void LoadOffice(json::value& office, model::Map& map_object) {
 	map_object.AddOffice(office_object);
 }
 
+model::LootTypeCatalog LoadLootTypes(const json::array& loot_types) {
+	model::LootTypeCatalog catalog;
+	for (const auto& loot_type : loot_types) {
+		const auto& object = loot_type.as_object();
+		model::LootType loot_type_object;
+		if (auto name = object.if_contains("name"))
+			loot_type_object.name = name->as_string().data();
+		if (auto file = object.if_contains("file"))
+			loot_type_object.file = file->as_string().data();
+		if (auto type = object.if_contains("type"))
+			loot_type_object.type = type->as_string().data();
+		if (auto rotation = object.if_contains("rotation"))
+			loot_type_object.rotation = rotation->to_number<int>();
+		if (auto color = object.if_contains("color"))
+			loot_type_object.color = color->as_string().data();
+		if (auto scale = object.if_contains("scale"))
+			loot_type_object.scale = scale->to_number<double>();
+		if (auto value = object.if_contains("value"))
+			loot_type_object.value = value->to_number<int>();
+		catalog.Add(std::move(loot_type_object));
+	}
+	return catalog;
+}
+
 void LoadMap(json::value& map, model::Game& game, const float& speed) {
 	std::string name = map.as_object().at("name"s).as_string().data();
 	std::string id = map.as_object().at("id").as_string().data();
 	int loot_types = map.as_object().at("lootTypes").as_array().size() - 1;
 	model::Map map_object(util::Tagged < std::string, model::Map >(id), name, loot_types);
 	map_object.SetLootObjectNumber(loot_types);
+	map_object.SetLootTypeCatalog(LoadLootTypes(map.as_object().at("lootTypes").as_array()));
 
 	for (auto& road : map.as_object().at("roads").as_array()) 
 		LoadRoad(road, map_object);
+	map_object.BuildRoadNetwork();
 
 	for (auto& building : map.as_object().at("buildings").as_array())
 		LoadBuilding(building, map_object);
 
 	for (auto& office : map.as_object().at("offices").as_array())
 		LoadOffice(office, map_object);
+	map_object.BuildOfficeIndex();
 
 	if (map.as_object().contains("dogSpeed")) {
 		map_object.SetDogSpeed(map.as_object()["dogSpeed"].as_double());
@@ -103,7 +110,7 @@ void LoadMap(json::value& map, model::Game& game, const float& speed) {
 	if(map.as_object().contains("bagCapacity"))	
 		map_object.SetBagCapacity(map.as_object()["bagCapacity"].as_int64());
 
-	game.AddMap(map_object);
+	game.AddMap(std::move(map_object));
 	game.AddJsonMap(util::Tagged < std::string, model::Map >(id), json::serialize(map));
 }
 
@@ -141,15 +141,39 @@ namespace log_response {
 				return;
 			LogRequest(req);
 			std::chrono::system_clock::time_point start_ts = std::chrono::system_clock::now(); 
-			std::pair<int, std::string> data = decorated_(ep, std::move(req), std::move(send));
-			std::chrono::system_clock::time_point end_ts = std::chrono::system_clock::now();
-			auto response_duration = (end_ts - start_ts).count();
-
-			LogResponse(response_duration, data.first, data.second);
-
+			decorated_(ep, std::move(req), LoggingSend<std::decay_t<Send>>(std::forward<Send>(send), start_ts));
 		}
 
 	private:
+		// Logs every response as it is sent. Requests handled on a strand are
+		// answered after the handler has returned, and several of them run at
+		// once, so the status and content type are taken from the response itself.
+		template <typename Send>
+		class LoggingSend {
+		public:
+			LoggingSend(Send send, std::chrono::system_clock::time_point start_ts)
+				: send_(std::move(send))
+				, start_ts_(start_ts) {
+			}
+
+			template <typename Response>
+			void operator()(Response&& response) const {
+				LogResponse((std::chrono::system_clock::now() - start_ts_).count(), response.result_int(),
+					std::string(response[http::field::content_type]));
+				send_(std::forward<Response>(response));
+			}
+
+			template <typename Request, typename MessageHandler>
+			auto AcceptWebSocket(Request&& request, MessageHandler&& on_message) const {
+				LogResponse((std::chrono::system_clock::now() - start_ts_).count(), static_cast<int>(http::status::switching_protocols), ""s);
+				return send_.AcceptWebSocket(std::forward<Request>(request), std::forward<MessageHandler>(on_message));
+			}
+
+		private:
+			Send send_;
+			std::chrono::system_clock::time_point start_ts_;
+		};
+
 		SomeRequestHandler decorated_;
 	};
 
@@ -6,11 +6,56 @@
 
 namespace loot_gen {
 
-unsigned GetRandomItem(unsigned max_item_number) {
+namespace {
+
+uint64_t SplitMix64(uint64_t& state) noexcept {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+constexpr uint64_t RotateLeft(uint64_t x, int k) noexcept {
+    return (x << k) | (x >> (64 - k));
+}
+
+}  // namespace
+
+RandomEngine::RandomEngine(uint64_t seed) noexcept {
+    for (auto& word : state_) {
+        word = SplitMix64(seed);
+    }
+}
+
+RandomEngine::result_type RandomEngine::operator()() noexcept {
+    const uint64_t result = RotateLeft(state_[1] * 5, 7) * 9;
+    const uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = RotateLeft(state_[3], 45);
+    return result;
+}
+
+uint64_t MakeRandomSeed() {
     std::random_device device;
-    std::mt19937 range(device());
-    std::uniform_int_distribution<std::mt19937::result_type> distribution(0, max_item_number);
-    return distribution(range);
+    return (uint64_t{device()} << 32) | device();
+}
+
+unsigned GetRandomItem(RandomEngine& engine, unsigned max_item_number) {
+    // Lemire's multiply-and-shift: the high half of a 32x32 product is uniform
+    // in [0, bound) once the few biased low halves are drawn again.
+    const uint64_t bound = uint64_t{max_item_number} + 1;
+    uint64_t product = (engine() >> 32) * bound;
+    if ((product & UINT32_MAX) < bound) {
+        const uint64_t threshold = ((uint64_t{1} << 32) - bound) % bound;
+        while ((product & UINT32_MAX) < threshold) {
+            product = (engine() >> 32) * bound;
+        }
+    }
+    return static_cast<unsigned>(product >> 32);
 }
 
 unsigned LootGenerator::Generate(TimeInterval time_delta, unsigned loot_count,
@@ -1,11 +1,48 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 
 namespace loot_gen {
 
-unsigned GetRandomItem(unsigned max_item_number);
+// xoshiro256** generator for the random choices of a game session. The state
+// is four words and a draw is a few shifts and multiplies. A session owns its
+// engine and only uses it from its own strand. With a fixed seed a session
+// makes the same choices on every run.
+class RandomEngine {
+public:
+    using result_type = uint64_t;
+
+    // The seed is spread over the state with splitmix64, so nearby seeds give
+    // unrelated sequences.
+    explicit RandomEngine(uint64_t seed) noexcept;
+
+    static constexpr result_type min() noexcept {
+        return 0;
+    }
+
+    static constexpr result_type max() noexcept {
+        return UINT64_MAX;
+    }
+
+    result_type operator()() noexcept;
+
+private:
+    std::array<uint64_t, 4> state_;
+};
+
+// A seed taken from the system for runs that are not given one.
+uint64_t MakeRandomSeed();
+
+// Uniformly distributed in [0, max_item_number].
+unsigned GetRandomItem(RandomEngine& engine, unsigned max_item_number);
+
+// Uniformly distributed in [0, 1).
+inline double GetRandomReal(RandomEngine& engine) noexcept {
+    return static_cast<double>(engine() >> 11) * 0x1.0p-53;
+}
 
 class LootGenerator {
 public:
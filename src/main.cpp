@@ -45,6 +45,7 @@ namespace {
         std::chrono::milliseconds tick_period = 0ms;
         std::chrono::milliseconds save_period = 0ms;
         bool randomize = false;
+        std::optional<uint64_t> random_seed;
     };
 
     [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
@@ -54,6 +55,7 @@ namespace {
 
         std::string tick_period;
         std::string save_period;
+        uint64_t random_seed = 0;
         Args args;
         desc.add_options()
             ("help,h", "produce help message")
@@ -61,6 +63,7 @@ namespace {
             ("config-file,c", po::value(&args.file)->value_name("file"), "set config file path")
             ("www-root,w", po::value(&args.dir)->value_name("dir"), "set static files root")
             ("randomize-spawn-points,r", "spawn dogs at random positions")
+            ("random-seed", po::value(&random_seed)->value_name("seed"), "seed the random choices of the game")
             ("state-file,s", po::value(&args.state_file)->value_name("file"), "set state file path")
             ("save-state-period,p", po::value(&save_period)->value_name("millisec"), "set state save period");
 
@@ -78,6 +81,10 @@ namespace {
             args.randomize = true;
         }
 
+        if (vm.contains("random-seed"s)) {
+            args.random_seed = random_seed;
+        }
+
         if (vm.contains("tick-period"s)) {
             args.tick_period = static_cast<std::chrono::milliseconds>(stoi(tick_period));
         }
@@ -145,7 +152,10 @@ int main(int argc, const char* argv[]) {
         model::Game game = json_loader::LoadGame(game_args.file);
         if(game_args.randomize)
             game.SetRandomMode();
-        players::Players players;
+        if(game_args.random_seed)
+            game.SetRandomSeed(*game_args.random_seed);
+        game.StartGameSessions();
+        players::Players players{game};
         players::PlayerTokens player_tokens;
 
         if(!game_args.state_file.empty()) 
@@ -155,8 +165,6 @@ int main(int argc, const char* argv[]) {
 
         fs::path static_files_root = game_args.dir;
 
-        auto api_strand = net::make_strand(ioc);
-
         net::signal_set signals(ioc, SIGINT, SIGTERM); 
         signals.async_wait([&ioc](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
             if (!ec) {
@@ -164,10 +172,11 @@ int main(int argc, const char* argv[]) {
             }
         });
 
+        application::Application app{ioc, game, players, player_tokens, conn_pool, game_args.save_period.count(), game_args.state_file,
+            game_args.tick_period};
+
         auto handler = std::make_shared<http_handler::RequestHandler>(
-            static_files_root, api_strand, game, players, player_tokens, game_args.tick_period.count(), conn_pool, game_args.save_period.count(), game_args.state_file);
-        
-        application::Application app{game, players, player_tokens, conn_pool, game_args.save_period.count(), game_args.state_file};
+            static_files_root, app, game, players, player_tokens, game_args.tick_period.count(), conn_pool);
 
         log_response::LoggingRequestHandler logging_handler{
             [handler](auto&& endpoint, auto&& req, auto&& send) {
@@ -183,7 +192,7 @@ int main(int argc, const char* argv[]) {
 
         if(game_args.tick_period != 0ms) {
             std::chrono::milliseconds delta = game_args.tick_period;
-            auto ticker = std::make_shared<http_handler::Ticker>(api_strand, delta,
+            auto ticker = std::make_shared<http_handler::Ticker>(app.GetStrand(), delta,
             [&app](std::chrono::milliseconds delta) { app.Tick(delta); }
             );
             ticker->Start();
@@ -0,0 +1,134 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <charconv>
+
+namespace metrics {
+
+using namespace std::literals;
+
+namespace {
+
+// Upper bounds of the exported histogram buckets in seconds, from tens of
+// microseconds for a request to seconds for a state save.
+constexpr std::array<double, 13> BUCKET_BOUNDS = {
+    0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0, 10.0,
+};
+
+constexpr double NS_IN_SEC = 1e9;
+
+void AppendNumber(std::string& text, double value) {
+    std::array<char, 32> buffer;
+    const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+    text.append(buffer.data(), result.ptr);
+}
+
+void AppendSeries(std::string& text, std::string_view name, std::string_view suffix, std::string_view labels) {
+    text.append(name);
+    text.append(suffix);
+    if (!labels.empty()) {
+        text.push_back('{');
+        text.append(labels);
+        text.push_back('}');
+    }
+    text.push_back(' ');
+}
+
+}  // namespace
+
+std::string_view GetRouteName(Route route) noexcept {
+    switch (route) {
+    case Route::MAPS:
+        return "maps"sv;
+    case Route::MAP:
+        return "map"sv;
+    case Route::JOIN:
+        return "join"sv;
+    case Route::PLAYERS:
+        return "players"sv;
+    case Route::STATE:
+        return "state"sv;
+    case Route::ACTION:
+        return "action"sv;
+    case Route::TICK:
+        return "tick"sv;
+    case Route::RECORDS:
+        return "records"sv;
+    case Route::STREAM:
+        return "stream"sv;
+    case Route::TICK_PROFILE:
+        return "tickProfile"sv;
+    case Route::METRICS:
+        return "metrics"sv;
+    case Route::STATIC:
+        return "static"sv;
+    case Route::UNKNOWN:
+        break;
+    }
+    return "unknown"sv;
+}
+
+ServerMetrics& GetServerMetrics() noexcept {
+    static ServerMetrics server_metrics;
+    return server_metrics;
+}
+
+void TextWriter::WriteHelp(std::string_view name, std::string_view type, std::string_view help) {
+    text_.append("# HELP "sv).append(name).append(" "sv).append(help).append("\n"sv);
+    text_.append("# TYPE "sv).append(name).append(" "sv).append(type).append("\n"sv);
+}
+
+void TextWriter::WriteSample(std::string_view name, std::string_view labels, double value) {
+    AppendSeries(text_, name, ""sv, labels);
+    AppendNumber(text_, value);
+    text_.push_back('\n');
+}
+
+void TextWriter::WriteHistogram(std::string_view name, std::string_view labels, const util::LatencyHistogram& histogram) {
+    using util::LatencyHistogram;
+
+    // A bucket of the histogram is counted under the first bound that is not
+    // below its highest value, so a bound may take in values up to 1/64 above it.
+    const std::string separator = labels.empty() ? ""s : ","s;
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (double bound : BUCKET_BOUNDS) {
+        const auto limit = static_cast<uint64_t>(bound * NS_IN_SEC);
+        while (bucket < LatencyHistogram::BUCKETS && LatencyHistogram::HighestInBucket(bucket) <= limit) {
+            cumulative += histogram.CountInBucket(bucket++);
+        }
+        std::string bucket_labels{labels};
+        bucket_labels.append(separator);
+        AppendNumber(bucket_labels.append("le=\""sv), bound);
+        bucket_labels.push_back('"');
+        WriteSample(std::string{name} + "_bucket"s, bucket_labels, static_cast<double>(cumulative));
+    }
+    while (bucket < LatencyHistogram::BUCKETS) {
+        cumulative += histogram.CountInBucket(bucket++);
+    }
+
+    // Records made during the scrape may reach the total before their bucket.
+    const uint64_t count = std::max(cumulative, histogram.Count());
+    WriteSample(std::string{name} + "_bucket"s, std::string{labels} + separator + "le=\"+Inf\""s, static_cast<double>(count));
+    WriteSample(std::string{name} + "_sum"s, labels, histogram.Sum() / NS_IN_SEC);
+    WriteSample(std::string{name} + "_count"s, labels, static_cast<double>(count));
+}
+
+std::string TextWriter::Label(std::string_view name, std::string_view value) {
+    std::string label{name};
+    label.append("=\""sv);
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            label.push_back('\\');
+            label.push_back(c);
+        } else if (c == '\n') {
+            label.append("\\n"sv);
+        } else {
+            label.push_back(c);
+        }
+    }
+    label.push_back('"');
+    return label;
+}
+
+}  // namespace metrics
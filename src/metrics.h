@@ -0,0 +1,110 @@
+#pragma once
+
+#include "util/latency_histogram.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace metrics {
+
+// Counters and gauges are single relaxed atomics, so the hot paths that update
+// them never take a lock and a scrape reads them from any thread.
+class Counter {
+public:
+    void Inc(uint64_t n = 1) noexcept {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t Value() const noexcept {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_ = 0;
+};
+
+class Gauge {
+public:
+    void Set(int64_t value) noexcept {
+        value_.store(value, std::memory_order_relaxed);
+    }
+
+    void Add(int64_t n) noexcept {
+        value_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t Value() const noexcept {
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> value_ = 0;
+};
+
+enum class Route {
+    MAPS,
+    MAP,
+    JOIN,
+    PLAYERS,
+    STATE,
+    ACTION,
+    TICK,
+    RECORDS,
+    STREAM,
+    TICK_PROFILE,
+    METRICS,
+    STATIC,
+    UNKNOWN,
+};
+
+constexpr size_t ROUTE_COUNT = static_cast<size_t>(Route::UNKNOWN) + 1;
+
+std::string_view GetRouteName(Route route) noexcept;
+
+// What the server as a whole reports. Latencies are in nanoseconds.
+struct ServerMetrics {
+    std::array<Counter, ROUTE_COUNT> requests;
+    std::array<util::LatencyHistogram, ROUTE_COUNT> request_latency;
+    Gauge http_sessions;
+    util::LatencyHistogram connection_wait;
+    Gauge snapshot_bytes;
+};
+
+// The connections, the pool and the handler are spread over the server without
+// a common owner, so they all report into one instance per process.
+ServerMetrics& GetServerMetrics() noexcept;
+
+// What a game session reports. It is published from the strand of its map and
+// read by scrapes from any thread.
+struct SessionMetrics {
+    Gauge players;
+    Gauge loot;
+    Counter retired;
+};
+
+// Builds a scrape in the Prometheus text exposition format. Labels are passed
+// as a ready list such as `route="maps"`, made with Label.
+class TextWriter {
+public:
+    void WriteHelp(std::string_view name, std::string_view type, std::string_view help);
+    void WriteSample(std::string_view name, std::string_view labels, double value);
+
+    // Writes the cumulative buckets, sum and count of a histogram of
+    // nanoseconds in seconds.
+    void WriteHistogram(std::string_view name, std::string_view labels, const util::LatencyHistogram& histogram);
+
+    std::string Release() noexcept {
+        return std::move(text_);
+    }
+
+    static std::string Label(std::string_view name, std::string_view value);
+
+private:
+    std::string text_;
+};
+
+}  // namespace metrics
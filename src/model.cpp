@@ -1,10 +1,182 @@
 #include "model.h"
 
+#include <algorithm>
 #include <stdexcept>
 
 namespace model {
 using namespace std::literals;
 
+namespace {
+
+// Slot 2 * n keeps the sections of the n-th line of road centers, slot 2 * n + 1
+// the sections of the gap between it and the next one.
+size_t SlotOf(Coord line, bool between, Coord min_line) noexcept {
+    return static_cast<size_t>(line - min_line) * 2 + (between ? 1 : 0);
+}
+
+constexpr double LANE_EPSILON = 1e-9;
+
+}  // namespace
+
+LaneIndex::LaneIndex(std::vector<Strip> strips) {
+    if (strips.empty()) {
+        return;
+    }
+
+    auto [min_it, max_it] = std::minmax_element(strips.begin(), strips.end(), [](const Strip& lhs, const Strip& rhs) {
+        return lhs.line < rhs.line;
+    });
+    min_line_ = min_it->line;
+    const size_t slots = SlotOf(max_it->line, true, min_line_) + 1;
+
+    std::sort(strips.begin(), strips.end(), [this](const Strip& lhs, const Strip& rhs) {
+        const size_t lhs_slot = SlotOf(lhs.line, lhs.between, min_line_);
+        const size_t rhs_slot = SlotOf(rhs.line, rhs.between, min_line_);
+        return lhs_slot != rhs_slot ? lhs_slot < rhs_slot : lhs.lane.begin < rhs.lane.begin;
+    });
+
+    slot_offsets_.assign(slots + 1, 0);
+    size_t current_slot = slots;
+    for (const Strip& strip : strips) {
+        const size_t slot = SlotOf(strip.line, strip.between, min_line_);
+        if (slot == current_slot && strip.lane.begin <= lanes_.back().end + LANE_EPSILON) {
+            lanes_.back().end = std::max(lanes_.back().end, strip.lane.end);
+            continue;
+        }
+        lanes_.push_back(strip.lane);
+        ++slot_offsets_[slot + 1];
+        current_slot = slot;
+    }
+    for (size_t slot = 0; slot < slots; ++slot) {
+        slot_offsets_[slot + 1] += slot_offsets_[slot];
+    }
+}
+
+const LaneIndex::Lane* LaneIndex::Find(double line, double along) const noexcept {
+    if (slot_offsets_.empty()) {
+        return nullptr;
+    }
+
+    const double nearest = std::round(line);
+    Coord row = static_cast<Coord>(nearest);
+    bool between = false;
+    if (std::abs(line - nearest) > RoadNetwork::ROAD_HALF_WIDTH + LANE_EPSILON) {
+        between = true;
+        if (line < nearest) {
+            --row;
+        }
+    }
+    if (row < min_line_) {
+        return nullptr;
+    }
+    const size_t slot = SlotOf(row, between, min_line_);
+    if (slot + 1 >= slot_offsets_.size()) {
+        return nullptr;
+    }
+
+    const auto lanes = LanesOf(slot);
+    auto it = std::upper_bound(lanes.begin(), lanes.end(), along, [](double value, const Lane& lane) {
+        return value + LANE_EPSILON < lane.begin;
+    });
+    if (it == lanes.begin() || along > std::prev(it)->end + LANE_EPSILON) {
+        return nullptr;
+    }
+    return &*std::prev(it);
+}
+
+RoadNetwork::RoadNetwork(const std::vector<Road>& roads) {
+    std::vector<LaneIndex::Strip> horizontal;
+    std::vector<LaneIndex::Strip> vertical;
+
+    // A road is a lane along its own line and a narrow crossing on every line
+    // of the other axis it passes, including the gaps between those lines.
+    auto add_road = [](std::vector<LaneIndex::Strip>& along, std::vector<LaneIndex::Strip>& across,
+                       Coord line, Coord from, Coord to) {
+        along.push_back({line, false, {from - ROAD_HALF_WIDTH, to + ROAD_HALF_WIDTH}});
+        const LaneIndex::Lane crossing{line - ROAD_HALF_WIDTH, line + ROAD_HALF_WIDTH};
+        for (Coord cross_line = from; cross_line <= to; ++cross_line) {
+            across.push_back({cross_line, false, crossing});
+            if (cross_line != to) {
+                across.push_back({cross_line, true, crossing});
+            }
+        }
+    };
+
+    for (const auto& road : roads) {
+        const Point start = road.GetStart();
+        const Point end = road.GetEnd();
+        if (road.IsHorizontal()) {
+            add_road(horizontal, vertical, start.y, std::min(start.x, end.x), std::max(start.x, end.x));
+        } else {
+            add_road(vertical, horizontal, start.x, std::min(start.y, end.y), std::max(start.y, end.y));
+        }
+    }
+
+    horizontal_ = LaneIndex(std::move(horizontal));
+    vertical_ = LaneIndex(std::move(vertical));
+}
+
+RoadNetwork::Movement RoadNetwork::Move(double x, double y, double speed_x, double speed_y, double time) const noexcept {
+    auto advance = [time](const LaneIndex& lanes, double line, double along, double speed, bool& stopped) {
+        const LaneIndex::Lane* lane = lanes.Find(line, along);
+        if (lane == nullptr) {
+            stopped = true;
+            return along;
+        }
+        const double expected = along + speed * time;
+        if (expected > lane->end) {
+            stopped = true;
+            return lane->end;
+        }
+        if (expected < lane->begin) {
+            stopped = true;
+            return lane->begin;
+        }
+        return expected;
+    };
+
+    Movement movement{x, y, false};
+    if (speed_x != 0.0) {
+        movement.x = advance(horizontal_, y, x, speed_x, movement.stopped);
+    } else if (speed_y != 0.0) {
+        movement.y = advance(vertical_, x, y, speed_y, movement.stopped);
+    }
+    return movement;
+}
+
+void SpawnSampler::AddRoad(const Road& road) {
+    const Point start = road.GetStart();
+    const Point end = road.GetEnd();
+    const double dx = end.x - start.x;
+    const double dy = end.y - start.y;
+    const double length = std::abs(dx) + std::abs(dy);
+    segments_.push_back({{static_cast<double>(start.x), static_cast<double>(start.y)},
+                         length > 0.0 ? dx / length : 0.0, length > 0.0 ? dy / length : 0.0});
+    cumulative_length_.push_back((cumulative_length_.empty() ? 0.0 : cumulative_length_.back()) + length);
+}
+
+geom::Point2D SpawnSampler::Sample(loot_gen::RandomEngine& engine) const {
+    const double total = cumulative_length_.back();
+    if (total == 0.0) {
+        // Every road is a single point, so all of them are equally likely.
+        return segments_[loot_gen::GetRandomItem(engine, segments_.size() - 1)].start;
+    }
+
+    const double distance = loot_gen::GetRandomReal(engine) * total;
+    const size_t road = std::min<size_t>(
+        std::upper_bound(cumulative_length_.begin(), cumulative_length_.end(), distance) - cumulative_length_.begin(),
+        segments_.size() - 1);
+    const double along = distance - (road > 0 ? cumulative_length_[road - 1] : 0.0);
+    const Segment& segment = segments_[road];
+    return {segment.start.x + segment.step_x * along, segment.start.y + segment.step_y * along};
+}
+
+void SpawnSampler::Sample(loot_gen::RandomEngine& engine, std::span<geom::Point2D> points) const {
+    for (auto& point : points) {
+        point = Sample(engine);
+    }
+}
+
 void Map::AddOffice(const Office& office) {
     if (warehouse_id_to_index_.contains(office.GetId())) {
         throw std::invalid_argument("Duplicate warehouse");
@@ -20,13 +192,22 @@ void Map::AddOffice(const Office& office) {
     }
 }
 
-void Game::AddMap(const Map& map) {
+void Map::BuildOfficeIndex() {
+    std::vector<collision_detector::Item> items;
+    items.reserve(offices_.size());
+    for (const auto& office : offices_) {
+        items.emplace_back(geom::Point2D{office.GetPosition().x * 1.0, office.GetPosition().y * 1.0}, Office::WIDTH);
+    }
+    office_index_ = collision_detector::ItemIndex(items);
+}
+
+void Game::AddMap(Map map) {
     const size_t index = maps_.size();
     if (auto [it, inserted] = map_id_to_index_.emplace(map.GetId(), index); !inserted) {
         throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
     } else {
         try {
-            maps_.emplace_back(std::move(map));
+            maps_.emplace_back(std::make_shared<const Map>(std::move(map)));
         } catch (...) {
             map_id_to_index_.erase(it);
             throw;
@@ -41,77 +222,187 @@ void Game::AddJsonMap(const Map::Id& id, const std::string& json_string) {
 
 
 
-bool Dog::TakeLoot(std::shared_ptr<LootObject> loot) {
-    if(bag_.size() < bag_capacity_ && loot) {
-        bag_.push_back(std::make_shared<LootObject>(*loot));
+size_t DogTable::Add(const std::string& name, int id, double nominal_speed, const geom::Point2D& coords) {
+    x.push_back(coords.x);
+    y.push_back(coords.y);
+    start_x.push_back(coords.x);
+    start_y.push_back(coords.y);
+    vx.push_back(0.0);
+    vy.push_back(0.0);
+    last_activity.push_back(0.0);
+    joined_at.push_back(clock);
+    flags.push_back(0);
+    retire_timer.emplace_back();
+    active_slot.push_back(NOT_ACTIVE);
+    cold.push_back(ColdData{.name = name, .id = id, .nominal_speed = nominal_speed, .dir = "U", .bag = {}, .bag_capacity = 0, .start_time = 0.0, .uuid = DogId::New()});
+    // A new dog stands still until it is given a direction.
+    stopped.push_back(cold.size() - 1);
+    return cold.size() - 1;
+}
+
+void DogTable::SetSpeed(size_t index, double speed_x, double speed_y) {
+    vx[index] = speed_x;
+    vy[index] = speed_y;
+    const bool moving = speed_x != 0.0 || speed_y != 0.0;
+    if (moving && !IsActive(index)) {
+        active_slot[index] = active.size();
+        active.push_back(index);
+    } else if (!moving && IsActive(index)) {
+        const size_t slot = active_slot[index];
+        active[slot] = active.back();
+        active_slot[active[slot]] = slot;
+        active.pop_back();
+        active_slot[index] = NOT_ACTIVE;
+        stopped.push_back(index);
+    }
+}
+
+size_t DogTable::Remove(size_t index) {
+    SetSpeed(index, 0.0, 0.0);
+    const size_t last = Size() - 1;
+    if (index != last) {
+        x[index] = x[last];
+        y[index] = y[last];
+        start_x[index] = start_x[last];
+        start_y[index] = start_y[last];
+        vx[index] = vx[last];
+        vy[index] = vy[last];
+        last_activity[index] = last_activity[last];
+        joined_at[index] = joined_at[last];
+        flags[index] = flags[last];
+        retire_timer[index] = retire_timer[last];
+        active_slot[index] = active_slot[last];
+        if (IsActive(index)) {
+            active[active_slot[index]] = index;
+        }
+        cold[index] = std::move(cold[last]);
+    }
+    x.pop_back();
+    y.pop_back();
+    start_x.pop_back();
+    start_y.pop_back();
+    vx.pop_back();
+    vy.pop_back();
+    last_activity.pop_back();
+    joined_at.pop_back();
+    flags.pop_back();
+    retire_timer.pop_back();
+    active_slot.pop_back();
+    cold.pop_back();
+    return last;
+}
+
+bool Dog::TakeLoot(const LootObject& loot) {
+    auto& bag = Cold().bag;
+    if(bag.size() < static_cast<size_t>(Cold().bag_capacity)) {
+        bag.push_back(loot);
         return true;
     }
     return false;
 }
 
 void Dog::SetDirection(const std::string& direction) {
+    const double nominal_speed = Cold().nominal_speed;
+    double speed_x = 0;
+    double speed_y = 0;
     if (direction == "L") {
-        speed_.x = -nominal_speed_;
-        speed_.y = 0;
+        speed_x = -nominal_speed;
+        speed_y = 0;
     }
     else if (direction == "R"){
-        speed_.x = nominal_speed_;
-        speed_.y = 0;
+        speed_x = nominal_speed;
+        speed_y = 0;
     }
     else if (direction == "U"){
-        speed_.x = 0;
-        speed_.y = -nominal_speed_;
+        speed_x = 0;
+        speed_y = -nominal_speed;
     }
     else if (direction == "D"){
-        speed_.x = 0;
-        speed_.y = nominal_speed_;
+        speed_x = 0;
+        speed_y = nominal_speed;
     }
     else{
-        speed_.x = 0;
-        speed_.y = 0;
+        speed_x = 0;
+        speed_y = 0;
     }
-    dir_ = direction;
+    table_->SetSpeed(index_, speed_x, speed_y);
+    Cold().dir = direction;
 }
 
-std::vector<std::shared_ptr<LootObject>> Dog::ReturnLoot() {
-    std::vector<std::shared_ptr<LootObject>> returned_loot = bag_;
-    bag_ = {};
+Dog::Bag Dog::ReturnLoot() {
+    Bag returned_loot = std::move(Cold().bag);
+    Cold().bag = {};
     return returned_loot;
 }
 
-const Point GameSession::GetRandomLocation() {
-    const model::Map::Roads roads = map_->GetRoads();
-    int road_number = loot_gen::GetRandomItem(roads.size()-1);
-    Road road = roads[road_number];
-    Point start = road.GetStart();
-    Point end = road.GetEnd();
-    int x = std::min(start.x, end.x) + loot_gen::GetRandomItem(std::abs(start.x - end.x));
-    int y = std::min(start.y, end.y) + loot_gen::GetRandomItem(std::abs(start.y - end.y));
-    return Point{x, y}; 
+Dog GameSession::AddDog(const std::string& name) {
+    const geom::Point2D start = GetLocation();
+    int dog_speed = map_->GetDogSpeed();
+    Dog dog(*dog_table_, dog_table_->Add(name, ids_++, dog_speed, start));
+    dog.SetBagCapacity(bag_capacity_);
+    return dog;
 }
 
-std::shared_ptr<Dog> GameSession::AddDog(const std::string& name) {
-    Point start = GetLocation();
-    int dog_speed = map_->GetDogSpeed();
-    dogs_.push_back(std::make_shared<Dog>(name, ids_++, dog_speed, start, timer_));
-    dogs_.back()->SetBagCapacity(bag_capacity_);
-    return dogs_.back();
+size_t GameSession::RemoveDog(size_t index) {
+    if (dog_table_->flags[index] & DogTable::RETIRED) {
+        --retired_;
+    }
+    // The loot left in the bag leaves the game with the dog.
+    for (const auto& loot : dog_table_->cold[index].bag) {
+        ReleaseLootId(loot.GetId());
+    }
+    retirement_wheel_.Cancel(dog_table_->retire_timer[index]);
+    const size_t moved_from = dog_table_->Remove(index);
+    // When the last row was removed there is no row left at index.
+    if (moved_from != index) {
+        if (auto* timer = retirement_wheel_.Get(dog_table_->retire_timer[index])) {
+            timer->dog = index;
+        }
+    }
+    return moved_from;
 }
 
-void GameSession::AddNewLoot(std::shared_ptr<LootObject> loot_object, int id) {
-    loot_object->SetPosition(GetLocation());
-    loot_objects_[id] = loot_object;
+GameSession::LootHandle GameSession::AddNewLoot(LootObject loot_object) {
+    const geom::Point2D location = GetLocation();
+    loot_object.SetPosition(Dog::Coords{location.x, location.y});
+    return AddLootObject(std::move(loot_object));
 }
 
-void GameSession::DeleteLootObject(int id) {
-    if(loot_objects_.contains(id)) 
-        loot_objects_.erase(id);
+void GameSession::GenerateLoot(const TimeInterval& time_interval) {
+    unsigned loot_count = loot_objects_.Size();
+    unsigned looter_count = GetNumberOfPlayers();
+    unsigned needed_loot = loot_generator_.Generate(time_interval, loot_count, looter_count);
+    if (needed_loot == 0) {
+        return;
+    }
+
+    std::vector<geom::Point2D> locations(needed_loot);
+    if (random_) {
+        map_->GetSpawnSampler().Sample(random_engine_, locations);
+    } else {
+        std::fill(locations.begin(), locations.end(), GetLocation());
+    }
+    for(const auto& location : locations) {
+        int loot_type = loot_gen::GetRandomItem(random_engine_, map_->GetLootObjectNumber());
+        LootObject loot(AcquireLootId(), loot_type);
+        loot.SetPosition(Dog::Coords{location.x, location.y});
+        AddLootObject(std::move(loot));
+    }
+}
+
+int GameSession::AcquireLootId() {
+    if (free_loot_ids_.empty()) {
+        return loot_number_++;
+    }
+    const int id = free_loot_ids_.back();
+    free_loot_ids_.pop_back();
+    return id;
 }
 
 const Map* Game::FindMap(const Map::Id& id) const noexcept {
     auto it = map_id_to_index_.find(id);
     if (it != map_id_to_index_.end()) {
-        return &maps_.at(it->second);
+        return maps_.at(it->second).get();
     }
     
     return nullptr;
@@ -125,25 +416,19 @@ std::string Game::GetJsonMap(const Map::Id& id) const noexcept {
 }
 
 GameSession& Game::StartGameSession(const Map& map) {
-    sessions_[map.GetId()] = GameSession(map, random_);
-    sessions_[map.GetId()].SetBagCapacity(map.GetBagCapacity() ? map.GetBagCapacity() : bag_capacity_);
-    sessions_[map.GetId()].RefreshTimer(timer_);
-    return sessions_[map.GetId()];
-}
-
-void Game::GenerateLoot(const TimeInterval& time_interval) {
-    for(auto& [map_id, session] : sessions_) {
-        unsigned loot_count = session.GetLootObjects().size();
-        unsigned looter_count = session.GetNumberOfPlayers();
-        unsigned needed_loot = loot_generator_.Generate(time_interval, loot_count, looter_count);
-        if(needed_loot) {
-            for(unsigned i = 0; i < needed_loot; ++i) {
-                int loot_max_type = session.GetMap().GetLootObjectNumber();
-                int loot_type = loot_gen::GetRandomItem(loot_max_type);
-                loot_objects_.push_back(std::make_shared<LootObject>(loot_number_++, loot_type));
-                session.AddNewLoot(loot_objects_.back(), loot_objects_.back()->GetId());
-            }
-        }
+    const size_t index = map_id_to_index_.at(map.GetId());
+    auto [it, inserted] = sessions_.insert_or_assign(map.GetId(),
+        GameSession(maps_.at(index), random_, loot_generator_, loot_gen::RandomEngine(random_seed_ + index)));
+    GameSession& session = it->second;
+    session.SetBagCapacity(map.GetBagCapacity() ? map.GetBagCapacity() : bag_capacity_);
+    session.RefreshTimer(timer_);
+    return session;
+}
+
+void Game::StartGameSessions() {
+    for(const auto& map : maps_) {
+        if(!HasGameSession(*map))
+            StartGameSession(*map);
     }
 }
 
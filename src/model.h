@@ -1,14 +1,21 @@
 #pragma once
 
+#include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
-#include <set>
+#include <optional>
+#include <span>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "collision_detector.h"
 #include "loot_generator.h"
+#include "util/slab_pool.h"
+#include "util/timing_wheel.h"
 #include "util/tagged_uuid.h"
 
 namespace model {
@@ -85,6 +92,102 @@ private:
     Point end_;
 };
 
+// Sections of the lines of one axis along which a dog can run without leaving
+// the roads. A section is the union of all the overlapping road strips crossing
+// the line, merged and sorted when the map is loaded, so the section a dog runs
+// in is found with a binary search and a whole tick is resolved in one step.
+class LaneIndex {
+public:
+    struct Lane {
+        double begin = 0.0;
+        double end = 0.0;
+    };
+
+    // A road strip as seen by the lines of the axis: it lies on the line of
+    // road centers `line` or, when `between` is set, covers the gap between
+    // `line` and `line + 1`.
+    struct Strip {
+        Coord line = 0;
+        bool between = false;
+        Lane lane;
+    };
+
+    LaneIndex() = default;
+    explicit LaneIndex(std::vector<Strip> strips);
+
+    // Section of the line at `line` containing `along`, or nullptr if the
+    // point is off the roads.
+    const Lane* Find(double line, double along) const noexcept;
+
+private:
+    std::span<const Lane> LanesOf(size_t slot) const noexcept {
+        return {lanes_.data() + slot_offsets_[slot], lanes_.data() + slot_offsets_[slot + 1]};
+    }
+
+    Coord min_line_ = 0;
+    std::vector<uint32_t> slot_offsets_;
+    std::vector<Lane> lanes_;
+};
+
+// Movement of dogs over the roads of a map.
+class RoadNetwork {
+public:
+    constexpr static double ROAD_HALF_WIDTH = 0.4;
+
+    struct Movement {
+        double x;
+        double y;
+        bool stopped;
+    };
+
+    RoadNetwork() = default;
+    explicit RoadNetwork(const std::vector<Road>& roads);
+
+    // Moves a dog from (x, y) with the given speed for `time` seconds. The dog
+    // runs through connected roads and stops at the end of the section.
+    Movement Move(double x, double y, double speed_x, double speed_y, double time) const noexcept;
+
+    // Sections along x, looked up by y and x.
+    const LaneIndex& GetHorizontalLanes() const noexcept {
+        return horizontal_;
+    }
+
+    // Sections along y, looked up by x and y.
+    const LaneIndex& GetVerticalLanes() const noexcept {
+        return vertical_;
+    }
+
+private:
+    LaneIndex horizontal_;
+    LaneIndex vertical_;
+};
+
+// Uniformly random points on the roads of a map: roads are weighted by their
+// length, so every stretch of road is as likely as any other. A draw is one
+// random number and a binary search over the running total of the lengths.
+class SpawnSampler {
+public:
+    void AddRoad(const Road& road);
+
+    geom::Point2D Sample(loot_gen::RandomEngine& engine) const;
+
+    // Fills the points with independent draws.
+    void Sample(loot_gen::RandomEngine& engine, std::span<geom::Point2D> points) const;
+
+private:
+    // Roads are axis-aligned, so a point of a road is its start plus the
+    // distance along it times a unit step.
+    struct Segment {
+        geom::Point2D start;
+        double step_x;
+        double step_y;
+    };
+
+    std::vector<Segment> segments_;
+    // Length of the roads up to and including each one.
+    std::vector<double> cumulative_length_;
+};
+
 class Building {
 public:
     explicit Building(Rectangle bounds) noexcept
@@ -103,6 +206,8 @@ class Office {
 public:
     using Id = util::Tagged<std::string, Office>;
 
+    constexpr static double WIDTH = 0.5;
+
     Office(Id id, Point position, Offset offset) noexcept
         : id_{std::move(id)}
         , position_{position}
@@ -127,6 +232,42 @@ private:
     Offset offset_;
 };
 
+struct LootType {
+    std::string name;
+    std::string file;
+    std::string type;
+    std::optional<int> rotation;
+    std::optional<std::string> color;
+    double scale = 1.0;
+    int value = 0;
+};
+
+// Loot types of a map as read from its config, indexed by the loot type number.
+// Values are also kept in an array of their own for the deposit phase.
+class LootTypeCatalog {
+public:
+    void Add(LootType loot_type) {
+        values_.push_back(loot_type.value);
+        types_.push_back(std::move(loot_type));
+    }
+
+    size_t Size() const noexcept {
+        return types_.size();
+    }
+
+    const LootType& At(size_t type) const {
+        return types_.at(type);
+    }
+
+    int GetValue(size_t type) const noexcept {
+        return type < values_.size() ? values_[type] : 0;
+    }
+
+private:
+    std::vector<LootType> types_;
+    std::vector<int> values_;
+};
+
 class Map {
 public:
     using Id = util::Tagged<std::string, Map>;
@@ -166,6 +307,7 @@ public:
 
     void AddRoad(const Road& road) {
         roads_.emplace_back(road);
+        spawn_sampler_.AddRoad(road);
     }
 
     void AddBuilding(const Building& building) {
@@ -186,16 +328,36 @@ public:
         return max_loot_object_number_;
     }
 
-    double GetDogSpeed() {
+    double GetDogSpeed() const {
         return default_dog_speed_;
     }
 
-    void AddRoadMap(const Point point, const Road& road) {
-        road_map_[point.x][point.y].insert(std::make_shared<Road>(road));
+    // Must be called once all the roads are added.
+    void BuildRoadNetwork() {
+        road_network_ = RoadNetwork(roads_);
+    }
+
+    const RoadNetwork& GetRoadNetwork() const noexcept {
+        return road_network_;
+    }
+
+    const SpawnSampler& GetSpawnSampler() const noexcept {
+        return spawn_sampler_;
     }
 
-    std::set<std::shared_ptr<Road>> GetRoadMap(const Point point) {
-        return road_map_[point.x][point.y];
+    const LootTypeCatalog& GetLootTypeCatalog() const noexcept {
+        return loot_type_catalog_;
+    }
+
+    void SetLootTypeCatalog(LootTypeCatalog catalog) {
+        loot_type_catalog_ = std::move(catalog);
+    }
+
+    // Offices never move, so the index is built once all of them are added.
+    void BuildOfficeIndex();
+
+    const collision_detector::ItemIndex& GetOfficeIndex() const noexcept {
+        return office_index_;
     }
 
     int GetBagCapacity() const {
@@ -216,10 +378,13 @@ private:
     int bag_capacity_ = 0;
     Roads roads_;
     Buildings buildings_;
-    std::unordered_map<int, std::unordered_map<int, std::set<std::shared_ptr<Road>>>> road_map_;
+    RoadNetwork road_network_;
+    SpawnSampler spawn_sampler_;
 
     OfficeIdToIndex warehouse_id_to_index_;
     Offices offices_;
+    collision_detector::ItemIndex office_index_;
+    LootTypeCatalog loot_type_catalog_;
     int max_loot_object_number_;
 };
 
@@ -232,22 +397,90 @@ namespace detail {
 
 using DogId = util::TaggedUUID<detail::DogTag>;
 
+// Armed when a dog stands still: fires when the dog would have been idle for
+// the retirement time, unless it has moved since.
+struct RetirementTimer {
+    size_t dog;
+    double last_activity;
+};
+
+using RetirementWheel = util::TimingWheel<RetirementTimer>;
+
+// Dogs of a session. The state that the tick reads and writes on every step is
+// kept in parallel arrays indexed by the dog's row, so the movement loop walks
+// contiguous memory. Everything else about a dog lives in the cold side table.
+//
+// Most dogs stand still most of the time, so the rows with a non-zero speed
+// are also kept in the active list and the tick only walks that list. Speeds
+// must therefore only be changed through SetSpeed. The time of a dog is the
+// table clock less the moment it joined, so standing dogs need no update.
+struct DogTable {
+    enum Flag : uint8_t {
+        RETIRED = 1 << 0,
+    };
+
+    constexpr static size_t NOT_ACTIVE = SIZE_MAX;
+
+    struct ColdData {
+        std::string name;
+        int id = 0;
+        double nominal_speed = 0.0;
+        std::string dir = "U";
+        std::vector<LootObject> bag;
+        int bag_capacity = 0;
+        double start_time = 0.0;
+        DogId uuid;
+    };
+
+    size_t Add(const std::string& name, int id, double nominal_speed, const geom::Point2D& coords);
+
+    // Removes the row by moving the last row into its place. Returns the former
+    // index of the moved row, which is the removed index if it was the last one.
+    size_t Remove(size_t index);
+
+    size_t Size() const noexcept {
+        return x.size();
+    }
+
+    // Keeps the active list in step with the speed. Rows that come to a stop
+    // are queued in stopped until the tick picks them up.
+    void SetSpeed(size_t index, double speed_x, double speed_y);
+
+    bool IsActive(size_t index) const noexcept {
+        return active_slot[index] != NOT_ACTIVE;
+    }
+
+    double CurrentTime(size_t index) const noexcept {
+        return clock - joined_at[index];
+    }
+
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<double> start_x;
+    std::vector<double> start_y;
+    std::vector<double> vx;
+    std::vector<double> vy;
+    std::vector<double> last_activity;
+    std::vector<double> joined_at;
+    std::vector<uint8_t> flags;
+    std::vector<RetirementWheel::TimerHandle> retire_timer;
+    std::vector<size_t> active_slot;
+    std::vector<ColdData> cold;
+
+    double clock = 0.0;
+    std::vector<size_t> active;
+    std::vector<size_t> stopped;
+};
+
+// A dog is a view of its row in the DogTable of the session.
 class Dog {
 public:
-    using Bag = std::vector<std::shared_ptr<LootObject>>;
-
-    Dog(const std::string& name, const int& id, const double& speed, const Point& coords, const double& start_time)
-        : name_(name)
-        , id_(id)
-        , nominal_speed_(speed)
-        , coords_({ coords.x, coords.y })
-        , start_coords_({ coords.x, coords.y })
-        , uuid_{DogId::New()}
-    {
-    }
+    using Bag = std::vector<LootObject>;
 
-    Dog(int id) 
-        : id_(id) {
+    Dog(DogTable& table, size_t index)
+        : table_(&table)
+        , index_(index)
+    {
     }
 
     struct Coords {
@@ -265,146 +498,154 @@ public:
     struct Speed {
         Speed() = default;
 
+        Speed(double x, double y)
+            : x(x)
+            , y(y)
+        {
+        }
+
         double x = 0;
         double y = 0;
     };
 
+    size_t GetIndex() const noexcept {
+        return index_;
+    }
+
     const std::string& GetName() const noexcept {
-        return name_;
+        return Cold().name;
     }
 
     void SetName(std::string name) {
-        name_ = name;
+        Cold().name = std::move(name);
     }
 
-    int GetId() {
-        return id_;
+    int GetId() const noexcept {
+        return Cold().id;
     }
 
-    const Coords& GetPosition() const noexcept {
-        return coords_;
+    Coords GetPosition() const noexcept {
+        return {table_->x[index_], table_->y[index_]};
     }
 
-    const Coords& GetStartPosition() const noexcept {
-        return start_coords_;
+    Coords GetStartPosition() const noexcept {
+        return {table_->start_x[index_], table_->start_y[index_]};
     }
 
     void SetPosition(double x, double y) {
-        start_coords_ = {coords_.x, coords_.y};
-        coords_.x = x;
-        coords_.y = y;
+        table_->start_x[index_] = table_->x[index_];
+        table_->start_y[index_] = table_->y[index_];
+        table_->x[index_] = x;
+        table_->y[index_] = y;
     }
 
-    const Speed& GetSpeed() const noexcept {
-        return speed_;
+    Speed GetSpeed() const noexcept {
+        return {table_->vx[index_], table_->vy[index_]};
     }
 
     void Stop() {
-        speed_.x = 0;
-        speed_.y = 0;
+        table_->SetSpeed(index_, 0.0, 0.0);
     }
 
     const std::string& GetDirection() const noexcept {
-        return dir_;
+        return Cold().dir;
     }
 
     void SetDirection(const std::string& direction);
 
-    bool TakeLoot(std::shared_ptr<LootObject> loot);
+    bool TakeLoot(const LootObject& loot);
 
     const int& GetBagCapacity() const noexcept {
-        return bag_capacity_;
+        return Cold().bag_capacity;
     }
 
     void SetBagCapacity(int bag_capacity) {
-        bag_capacity_ = bag_capacity;
+        Cold().bag_capacity = bag_capacity;
     }
 
-    std::vector<std::shared_ptr<LootObject>> ReturnLoot();
+    Bag ReturnLoot();
 
     double GetRetirementTime() {
-        if(std::abs(speed_.x - speed_.y) > std::numeric_limits<double>::epsilon()) {
-            last_activity_ = current_time_;
+        if(std::abs(table_->vx[index_] - table_->vy[index_]) > std::numeric_limits<double>::epsilon()) {
+            table_->last_activity[index_] = GetCurrentTime();
         }
 
-        return current_time_ - last_activity_;
+        return GetCurrentTime() - table_->last_activity[index_];
     }
 
     void RefreshTime(double time) {
-        current_time_ += time;
+        table_->joined_at[index_] -= time;
+    }
+
+    bool IsRetired() const noexcept {
+        return table_->flags[index_] & DogTable::RETIRED;
+    }
+
+    void Retire() {
+        table_->flags[index_] |= DogTable::RETIRED;
     }
 
     const DogId& GetUUID() const noexcept {
-        return uuid_;
+        return Cold().uuid;
     }
 
     void SetUUID(const std::string& new_uuid) noexcept {
-        *uuid_ = util::detail::UUIDFromString(new_uuid);
+        *Cold().uuid = util::detail::UUIDFromString(new_uuid);
     }
 
     const double& GetStartTime() const noexcept {
-        return start_time_;
+        return Cold().start_time;
     }
 
     void SetStartTime(const double& time) {
-        start_time_ = time;
+        Cold().start_time = time;
     }
 
-    const double& GetCurrentTime() const noexcept {
-        return current_time_;
+    double GetCurrentTime() const noexcept {
+        return table_->CurrentTime(index_);
     }
 
     void SetCurrentTime(const double& time) {
-        current_time_ = time;
+        table_->joined_at[index_] = table_->clock - time;
     }
 
     const double& GetNominalSpeed() const noexcept {
-        return nominal_speed_;
-    }
-
-    const int& GetId() const noexcept {
-        return id_;
+        return Cold().nominal_speed;
     }
 
     const Bag& GetBag() const noexcept {
-        return bag_;
+        return Cold().bag;
     }
 
-    const double GetActivityTime() const noexcept {
-        return last_activity_;
+    double GetActivityTime() const noexcept {
+        return table_->last_activity[index_];
     }
 
     void SetActivityTime(const double& time) {
-        last_activity_ = time;
+        table_->last_activity[index_] = time;
     }
 
     void SetCoords(const Coords& coords) {
-        coords_ = coords;
+        table_->x[index_] = coords.x;
+        table_->y[index_] = coords.y;
     }
 
     void SetStartCoords(const Coords& coords) {
-        start_coords_ = coords;
+        table_->start_x[index_] = coords.x;
+        table_->start_y[index_] = coords.y;
     }
 
     void SetNominalSpeed(const double& speed) {
-        nominal_speed_ = speed;
+        Cold().nominal_speed = speed;
     }
 
 private:
+    DogTable::ColdData& Cold() const noexcept {
+        return table_->cold[index_];
+    }
 
-    std::string name_;
-    int id_ = 0;
-    double nominal_speed_ = 0.0;
-    Coords coords_;
-    Coords start_coords_;
-    Speed speed_;
-    std::string dir_ = "U";
-    Bag bag_ = {};
-    int bag_capacity_ = 0;
-    double last_activity_ = 0.0;
-    double start_time_ = 0.0;
-    double current_time_ = 0.0;
-    DogId uuid_;
+    DogTable* table_;
+    size_t index_;
 };
 
 
@@ -447,70 +688,131 @@ public:
         coords_ = location;
     }
 
-    void SetInvisible() {
-        visible_ = false;
-    }
-
-    const bool& IsVisible() const noexcept {
-        return visible_;
-    }
-
 private:
     int id_ = 0;
     int type_ = 0;
     model::Dog::Coords coords_{0, 0};
-    bool visible_ = true;
 };
 
 class GameSession {
 public:
-    GameSession() {
-
-    }
-
-    GameSession(const Map& map, bool random) 
-        : map_(std::make_shared<Map>(map))
-        , dogs_{}
+    using TimeInterval = loot_gen::LootGenerator::TimeInterval;
+    using LootPool = util::SlabPool<LootObject>;
+    using LootHandle = LootPool::Handle;
+
+    // Maps are immutable once loaded, so all the sessions of a map share it.
+    GameSession(std::shared_ptr<const Map> map, bool random, loot_gen::LootGenerator loot_generator,
+                loot_gen::RandomEngine random_engine) 
+        : map_(std::move(map))
         , ids_(0)
         , random_(random)
+        , loot_generator_(std::move(loot_generator))
+        , random_engine_(random_engine)
     {
     }
 
-    Map& GetMap() {
+    const Map& GetMap() const {
         return *map_;
     }
 
-    const Point GetRandomLocation();
+    geom::Point2D GetRandomLocation() {
+        return map_->GetSpawnSampler().Sample(random_engine_);
+    }
 
-    const Point GetLocation() {
-        return random_ ? GetRandomLocation() : map_->GetRoads().front().GetStart();
+    geom::Point2D GetLocation() {
+        const Point start = map_->GetRoads().front().GetStart();
+        return random_ ? GetRandomLocation() : geom::Point2D{static_cast<double>(start.x), static_cast<double>(start.y)};
     }
 
-    std::shared_ptr<Dog> AddDog(const std::string& name);
+    Dog AddDog(const std::string& name);
 
-    void AddNewLoot(std::shared_ptr<LootObject> loot_object, int id);
+    // Places the loot at a random point of the roads.
+    LootHandle AddNewLoot(LootObject loot_object);
 
-    const std::unordered_map<int, std::shared_ptr<LootObject>>& GetLootObjects() const {
+    // Keeps the loot where it is, as when the session is restored.
+    LootHandle AddLootObject(LootObject loot_object) {
+        return loot_objects_.Emplace(std::move(loot_object));
+    }
+
+    const LootPool& GetLootObjects() const {
         return loot_objects_;
     }
 
-    std::unordered_map<int, std::shared_ptr<LootObject>>& GetLootObjects() {
+    LootPool& GetLootObjects() {
         return loot_objects_;
     }
 
     unsigned GetNumberOfPlayers() {
-        return dogs_.size() - retired_;
+        return dog_table_->Size() - retired_;
     }
 
     void AddRetiredOne() {
         ++retired_;
     }
 
-    std::vector<std::shared_ptr<Dog>>& GetDogs() {
-        return dogs_;
+    // Drops the row of a dog that has left the game. The last row of the table
+    // takes its place; returns the index it was moved from, as DogTable::Remove.
+    size_t RemoveDog(size_t index);
+
+    DogTable& GetDogTable() {
+        return *dog_table_;
+    }
+
+    const DogTable& GetDogTable() const {
+        return *dog_table_;
+    }
+
+    void DeleteLootObject(LootHandle handle) {
+        loot_objects_.Erase(handle);
+    }
+
+    void GenerateLoot(const TimeInterval& time_interval);
+
+    // Loot ids are handed out to clients, so an id is only reused once its loot
+    // has left the game: it is released when the loot is deposited at an office,
+    // not when a dog picks it up and the id is still shown in the bag.
+    int AcquireLootId();
+
+    void ReleaseLootId(int id) {
+        free_loot_ids_.push_back(id);
+    }
+
+    const int& GetLootNumber() const noexcept {
+        return loot_number_;
+    }
+
+    void SetLootNumber(int number) {
+        loot_number_ = number;
     }
 
-    void DeleteLootObject(int id);
+    const std::vector<int>& GetFreeLootIds() const noexcept {
+        return free_loot_ids_;
+    }
+
+    void SetFreeLootIds(std::vector<int> ids) {
+        free_loot_ids_ = std::move(ids);
+    }
+
+    // Time only moves forward: the clock is unsigned, so a negative delta would
+    // wrap it around.
+    void AddTime(const double& time_delta) {
+        assert(time_delta >= 0);
+        if (!(time_delta > 0)) {
+            return;
+        }
+        timer_ += time_delta;
+        clock_ms_ += static_cast<uint64_t>(std::llround(time_delta * 1000));
+    }
+
+    // Milliseconds the session has been stepped for. The retirement wheel runs
+    // on this clock rather than on the game timer, which is restored from disk.
+    uint64_t GetClockMs() const noexcept {
+        return clock_ms_;
+    }
+
+    RetirementWheel& GetRetirementWheel() {
+        return retirement_wheel_;
+    }
 
     void SetBagCapacity(int bag_capacity) {
         bag_capacity_ = bag_capacity;
@@ -545,20 +847,27 @@ public:
     }
 
 private:
-    std::shared_ptr<Map> map_;
-    std::vector<std::shared_ptr<Dog>> dogs_;
+    std::shared_ptr<const Map> map_;
+    // Dogs are views of rows of the table, so it must keep its address
+    std::shared_ptr<DogTable> dog_table_ = std::make_shared<DogTable>();
     int ids_ = 0;
     bool random_ = false;
-    std::unordered_map<int, std::shared_ptr<LootObject>> loot_objects_{};
+    loot_gen::LootGenerator loot_generator_;
+    loot_gen::RandomEngine random_engine_;
+    LootPool loot_objects_;
+    int loot_number_ = 0;
+    std::vector<int> free_loot_ids_;
     int bag_capacity_ = 0;
     double timer_ = 0.0;
+    uint64_t clock_ms_ = 0;
+    RetirementWheel retirement_wheel_;
     int retired_ = 0;
 };
 
 
 class Game {
 public:
-    using Maps = std::vector<Map>;
+    using Maps = std::vector<std::shared_ptr<const Map>>;
     using TimeInterval = std::chrono::milliseconds;
 
     Game(TimeInterval period, double probability) 
@@ -566,7 +875,7 @@ public:
         {
         }
 
-    void AddMap(const Map& map);
+    void AddMap(Map map);
     void AddJsonMap(const Map::Id& id, const std::string& json_string);
 
     const Maps& GetMaps() const noexcept {
@@ -579,8 +888,12 @@ public:
 
     GameSession& StartGameSession(const Map& map);
 
+    // Sessions of all maps are started up front so that the set of sessions never
+    // changes while the per-map strands are running.
+    void StartGameSessions();
+
     GameSession& GetGameSession(const Map& map) {
-        return HasGameSession(map) ? sessions_[map.GetId()] : StartGameSession(map);
+        return HasGameSession(map) ? sessions_.at(map.GetId()) : StartGameSession(map);
     }
 
     const auto& GetGameSessions() const {
@@ -595,20 +908,6 @@ public:
         return sessions_.contains(map.GetId());
     }
 
-    void GenerateLoot(const TimeInterval& time_interval);
-
-    void SetLootObjects(std::vector<std::shared_ptr<LootObject>>& loot_objects) {
-        loot_objects_ = loot_objects;
-    }
-
-    const std::vector<std::shared_ptr<LootObject>> GetLootObjects() const {
-        return loot_objects_;
-    }
-
-    std::vector<std::shared_ptr<LootObject>>& GetLootObjects() {
-        return loot_objects_;
-    }
-
     void SetRandomMode() {
         random_ = true;
     }
@@ -617,6 +916,16 @@ public:
         return random_;
     }
 
+    // Sessions started afterwards draw from engines seeded with this seed and
+    // the index of their map.
+    void SetRandomSeed(uint64_t seed) {
+        random_seed_ = seed;
+    }
+
+    uint64_t GetRandomSeed() const noexcept {
+        return random_seed_;
+    }
+
     void SetBagCapacity(int bag_capacity) {
         bag_capacity_ = bag_capacity;
     }
@@ -641,14 +950,6 @@ public:
         timer_ += time_delta;
     }
 
-    const int& GetLootNumber() const noexcept {
-        return loot_number_;
-    }
-
-    void SetLootNumber(int number) {
-        loot_number_ = number;
-    }
-
     void SetTimer(int timer) {
         timer_ = timer;
     }
@@ -660,15 +961,14 @@ private:
 
     loot_gen::LootGenerator loot_generator_;
     TimeInterval time_interval = 0ms;
-    std::vector<Map> maps_{};
+    Maps maps_{};
     MapIdToIndex map_id_to_index_{};
     std::unordered_map<Map::Id, std::string, MapIdHasher> maps_to_json_{};
     std::unordered_map<Map::Id, GameSession, MapIdHasher> sessions_{};
     double dog_retirement_time_ = 60.0;
     double timer_ = 0.0;
-    int loot_number_ = 0;
-	std::vector<std::shared_ptr<LootObject>> loot_objects_{};
     bool random_ = false;
+    uint64_t random_seed_ = loot_gen::MakeRandomSeed();
     int bag_capacity_ = 3;
     
 };
@@ -7,15 +7,15 @@ namespace players {
 		}
 
 		const std::string& Player::GetName()  const noexcept {
-			return dog_->GetName();
+			return dog_.GetName();
 		}
 
 		model::Dog& Player::GetDog() {
-			return *dog_;
+			return dog_;
 		}
 
 		const model::Dog& Player::GetDog() const noexcept {
-			return *dog_;
+			return dog_;
 		}
 
 		model::GameSession& Player::GetGameSession() {
@@ -30,17 +30,39 @@ namespace players {
 			return value_;
 		}
 
-        std::shared_ptr<Player> PlayerTokens::FindPlayerByToken(Token& token) {
-			return token_to_player_.contains(token) ? token_to_player_[token] : nullptr;
+        std::optional<PlayerRef> PlayerTokens::FindPlayerByToken(const Token& token) const {
+			std::shared_lock lock{mutex_};
+			auto it = token_to_player_.find(token);
+			if (it == token_to_player_.end())
+				return std::nullopt;
+			return it->second;
 		}
 
-		Token& PlayerTokens::AddPlayer(std::shared_ptr<Player> player) {
+		std::optional<Token> PlayerTokens::FindTokenByPlayer(int player_id) const {
+			std::shared_lock lock{mutex_};
+			auto it = player_to_token_.find(player_id);
+			if (it == player_to_token_.end())
+				return std::nullopt;
+			return it->second;
+		}
+
+		Token PlayerTokens::AddPlayer(PlayerRef player) {
+			std::lock_guard lock{mutex_};
 			Token token(GenerateToken());
 			while (token_to_player_.contains(token))
 				*token = GenerateToken();
-			token_to_player_[token] = player;
-			tokens_.push_back(token);
-			return tokens_.back();
+			player_to_token_.insert_or_assign(player.id, token);
+			token_to_player_.emplace(token, std::move(player));
+			return token;
+		}
+
+		void PlayerTokens::Remove(const Token& token) {
+			std::lock_guard lock{mutex_};
+			auto it = token_to_player_.find(token);
+			if (it == token_to_player_.end())
+				return;
+			player_to_token_.erase(it->second.id);
+			token_to_player_.erase(it);
 		}
 
         std::string PlayerTokens::GenerateToken() {
@@ -51,14 +73,40 @@ namespace players {
 			return std::string(stream.str());
 		}
 
-        std::shared_ptr<Player> Players::Add(std::shared_ptr<model::Dog> dog, model::GameSession& session) {
-			players_.push_back(std::make_shared<Player>(session, dog, ids_++));
-			players_by_dogid_mapid_[dog->GetId()][session.GetMap().GetId()] = players_.back();
-			return players_.back();
+        Players::Players(const model::Game& game) {
+			for (const auto& map : game.GetMaps())
+				session_players_[map->GetId()];
+		}
+
+        PlayerRef Players::Add(model::Dog dog, model::GameSession& session) {
+			return Add(dog, session, ids_++);
+		}
+
+        PlayerRef Players::Add(model::Dog dog, model::GameSession& session, int id) {
+			int next_id = ids_.load();
+			while (next_id <= id && !ids_.compare_exchange_weak(next_id, id + 1)) {
+			}
+			const auto& map_id = session.GetMap().GetId();
+			auto handle = session_players_.at(map_id).Emplace(session, dog, id);
+			return {map_id, handle, id};
+		}
+
+		Player* Players::Find(const PlayerRef& ref) {
+			auto it = session_players_.find(ref.map_id);
+			return it != session_players_.end() ? it->second.Get(ref.handle) : nullptr;
+		}
+
+		const Player* Players::Find(const PlayerRef& ref) const {
+			auto it = session_players_.find(ref.map_id);
+			return it != session_players_.end() ? it->second.Get(ref.handle) : nullptr;
 		}
 		
-		std::vector<std::shared_ptr<Player>>& Players::GetPlayers() {
-			return players_;
+		Players::SessionPlayers& Players::GetPlayers(const model::Map::Id& map_id) {
+			return session_players_.at(map_id);
+		}
+
+		const Players::SessionPlayers& Players::GetPlayers(const model::Map::Id& map_id) const {
+			return session_players_.at(map_id);
 		}
 
 } // namespace players
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "model.h"
+#include "util/slab_pool.h"
 
+#include <atomic>
 #include <memory>
+#include <optional>
 #include <random>
+#include <shared_mutex>
 #include <sstream>
 #include <unordered_map>
 
@@ -15,11 +19,10 @@ namespace players {
 
 	class Player {
 	public:
-		Player(model::GameSession& session, std::shared_ptr<model::Dog> dog, int id, bool online=true) 
-			: session_(std::make_shared<model::GameSession>(session))
+		Player(model::GameSession& session, model::Dog dog, int id) 
+			: session_(&session)
 			, dog_(dog)
 			, id_(id)
-			, online_(online)
 		{
 		}
 
@@ -28,47 +31,74 @@ namespace players {
 		model::Dog& GetDog();
 		const model::Dog& GetDog() const noexcept;
 		model::GameSession& GetGameSession();
+		// Points the player to the row its dog was moved to.
+		void SetDog(model::Dog dog) {
+			dog_ = dog;
+		}
 		void AddValue(int value);
 		const int& GetValue() const noexcept;
 		void SetOffline() {
-			online_ = false;
+			dog_.Retire();
 		}
-		const bool& IsOnline() const noexcept {
-			return online_;
+		bool IsOnline() const noexcept {
+			return !dog_.IsRetired();
 		}
 		const std::string& GetMapId() const noexcept {
 			return *session_->GetMap().GetId();
 		}
 
 	private:
-		std::shared_ptr<model::GameSession> session_;
-		std::shared_ptr<model::Dog> dog_;
+		// Sessions are owned by the game and outlive their players.
+		model::GameSession* session_;
+		model::Dog dog_;
 		int id_;
 		int value_ = 0;
-		bool online_ = true;
 	};
 
 	using Token = util::Tagged<std::string, detail::TokenTag>;
+	using PlayerHandle = util::Handle<Player>;
+
+	// Where a player lives: the partition of its map and its slot there. The id
+	// is kept alongside so that the API can answer without resolving the handle.
+	struct PlayerRef {
+		model::Map::Id map_id;
+		PlayerHandle handle;
+		int id = 0;
+	};
 
+	// Tokens are looked up by every API request before it is routed to the strand
+	// of its map, so the table is shared between the strands and guarded by a
+	// reader-writer lock: lookups take it shared, only joins take it exclusively.
 	class PlayerTokens {
 	public:
-		std::shared_ptr<Player> FindPlayerByToken(Token& token);
-		Token& AddPlayer(std::shared_ptr<Player> player);
-		const std::vector<Token> GetTokens() const noexcept {
-			return tokens_;
+		std::optional<PlayerRef> FindPlayerByToken(const Token& token) const;
+		std::optional<Token> FindTokenByPlayer(int player_id) const;
+		Token AddPlayer(PlayerRef player);
+		const std::vector<Token> GetTokens() const {
+			std::shared_lock lock{mutex_};
+			std::vector<Token> tokens;
+			tokens.reserve(token_to_player_.size());
+			for (const auto& [token, player] : token_to_player_)
+				tokens.push_back(token);
+			return tokens;
 		}
-		void AddPlayerWithToken(Token token, std::shared_ptr<Player> player) {
-			tokens_.push_back(std::move(token));
-			token_to_player_[tokens_.back()] = player;
+		void AddPlayerWithToken(Token token, PlayerRef player) {
+			std::lock_guard lock{mutex_};
+			player_to_token_.insert_or_assign(player.id, token);
+			token_to_player_.insert_or_assign(std::move(token), std::move(player));
 		}
-		const std::shared_ptr<Player> GetPlayerByToken(const Token& token) const noexcept {
-			return token_to_player_.contains(token) ? token_to_player_.at(token) : nullptr;
+		std::optional<PlayerRef> GetPlayerByToken(const Token& token) const {
+			return FindPlayerByToken(token);
 		}
+		// Forgets the token of a player that has left the game, so the table only
+		// holds the players still in it.
+		void Remove(const Token& token);
 
 	private:
 		using TokenHasher = util::TaggedHasher<Token>;
-		std::unordered_map<Token, std::shared_ptr<Player>, TokenHasher> token_to_player_;
-		std::vector<Token> tokens_;
+		mutable std::shared_mutex mutex_;
+		std::unordered_map<Token, PlayerRef, TokenHasher> token_to_player_;
+		std::unordered_map<int, Token> player_to_token_;
 		std::random_device random_device_;
 		std::mt19937_64 generator1_{[this] {
 									std::uniform_int_distribution < std::mt19937_64::result_type> dist;
@@ -82,27 +112,32 @@ namespace players {
 		std::string GenerateToken();
 	};
 
+	// Players are partitioned by map. Partitions are created for every map up front
+	// and each one is only touched from the strand of its map, so joins and ticks
+	// of different maps never contend with each other. Players of a partition are
+	// kept by value in a slab pool and referred to by generational handles.
 	class Players {
 	public:
-		Players() 
-		{
-		}
+		using SessionPlayers = util::SlabPool<Player>;
 
-		std::shared_ptr<Player> Add(std::shared_ptr<model::Dog> dog, model::GameSession& session);
-		std::vector<std::shared_ptr<Player>>& GetPlayers();
-		const std::vector<std::shared_ptr<Player>>& GetConstPlayers() const noexcept {
-			return players_;
-		}
+		explicit Players(const model::Game& game);
+
+		PlayerRef Add(model::Dog dog, model::GameSession& session);
+		PlayerRef Add(model::Dog dog, model::GameSession& session, int id);
+		// Returns nullptr if the player is gone.
+		Player* Find(const PlayerRef& ref);
+		const Player* Find(const PlayerRef& ref) const;
+		SessionPlayers& GetPlayers(const model::Map::Id& map_id);
+		const SessionPlayers& GetPlayers(const model::Map::Id& map_id) const;
 
-		const int& GetIds() const noexcept {
+		int GetIds() const noexcept {
 			return ids_;
 		}
 
 	private:
-		int ids_ = 0;
 		using MapIdHasher = util::TaggedHasher<model::Map::Id>;
-		std::vector<std::shared_ptr<Player>> players_;
-		std::unordered_map<int, std::unordered_map<model::Map::Id, std::shared_ptr<Player>, MapIdHasher>> players_by_dogid_mapid_;
+		std::atomic<int> ids_ = 0;
+		std::unordered_map<model::Map::Id, SessionPlayers, MapIdHasher> session_players_;
 	};
 
 } // namespace player
\ No newline at end of file
@@ -1,9 +1,10 @@
 #include "request_handler.h"
-#include "collision_detector.h"
 #include "serialization.h"
 
 #include <algorithm>
+#include <charconv>
 #include <iostream> 
+#include <optional>
 
 namespace http_handler {
 
@@ -43,22 +44,16 @@ namespace http_handler {
             res.prepare_payload();
         }
 
-        content_type_ = res[http::field::content_type];
-        status_ = res.result_int();
-
         return res;
     }
 
-    StringResponse RequestHandler::ReportServerError(unsigned version, bool keep_alive) {
+    StringResponse RequestHandler::ReportServerError(unsigned version, bool keep_alive) const {
         StringResponse response(http::status::internal_server_error, version);
         response.set(http::field::content_type, "application / json"s);
         response.body() = "{\"server error\"}"s;
         response.content_length(16);
         response.keep_alive(keep_alive);
 
-        content_type_ = response[http::field::content_type];
-        status_ = response.result_int();
-
         return response;
     }
 
@@ -86,43 +81,145 @@ namespace http_handler {
         return response;
     }
 
-    StringResponse RequestHandler::HandleApiRequest(const StringRequest& request) {
+    SharedStringResponse RequestHandler::MakeSharedStringResponse(http::status status, std::shared_ptr<const std::string> body, unsigned version, bool keep_alive, std::string_view content_type) const {
+        SharedStringResponse response(status, version);
+        response.set(http::field::content_type, content_type);
+        response.content_length(http_server::SharedStringBody::size(body));
+        response.body() = std::move(body);
+        response.set(http::field::cache_control, "no-cache"s);
+        response.keep_alive(keep_alive);
+
+        return response;
+    }
+
+    void RequestHandler::HandleApiRequest(const StringRequest& request, ApiResponder respond) {
+        const auto start = std::chrono::steady_clock::now();
         auto stop = request.target().find_first_of('?');
         std::string api_request = std::string(request.target().substr(0, stop));
-        StringResponse response;
-        if (api_request == "/api/v1/maps"s)
+        // Requests that change the game are answered once the change is published.
+        if (api_request == "/api/v1/game/join"s) {
+            return HandleApiRequestJoinGame(request, RecordOnResponse(metrics::Route::JOIN, start, std::move(respond)));
+        }
+        if (api_request == "/api/v1/game/player/action"s) {
+            return HandleApiRequestGamePlayerAction(request, RecordOnResponse(metrics::Route::ACTION, start, std::move(respond)));
+        }
+        if (api_request == "/api/v1/game/tick"s && tick_period_ == 0) {
+            return HandleApiRequestGameTick(request, RecordOnResponse(metrics::Route::TICK, start, std::move(respond)));
+        }
+
+        ApiRequestResult response;
+        metrics::Route route = metrics::Route::UNKNOWN;
+        if (api_request == "/api/v1/maps"s) {
+            route = metrics::Route::MAPS;
             response = HandleApiRequestGetMaps(request);
-        else if (api_request.substr(0, 13) == "/api/v1/maps/"s)
+        } else if (api_request.substr(0, 13) == "/api/v1/maps/"s) {
+            route = metrics::Route::MAP;
             response = HandleApiRequestGetMap(request);
-        else if (api_request == "/api/v1/game/join"s)
-            response = HandleApiRequestJoinGame(request);
-        else if (api_request == "/api/v1/game/players"s)
+        } else if (api_request == "/api/v1/game/players"s) {
+            route = metrics::Route::PLAYERS;
             response = HandleApiRequestGetPlayers(request);
-        else if (api_request == "/api/v1/game/state"s)
+        } else if (api_request == "/api/v1/game/state"s) {
+            route = metrics::Route::STATE;
             response = HandleApiRequestGameState(request);
-        else if (api_request == "/api/v1/game/player/action"s)
-            response = HandleApiRequestGamePlayerAction(request);
-        else if (api_request == "/api/v1/game/tick"s && tick_period_ == 0)
-            response = HandleApiRequestGameTick(request);
-        else if (api_request == "/api/v1/game/records"s)
+        } else if (api_request == "/api/v1/game/records"s) {
+            route = metrics::Route::RECORDS;
             response = HandleApiRequestGameRecords(request);
-        else 
+        } else if (api_request == "/api/v1/admin/tick-profile"s) {
+            route = metrics::Route::TICK_PROFILE;
+            response = HandleApiRequestTickProfile(request);
+        } else {
             response = MakeStringError(http::status::bad_request, request.version());
+        }
+
+        RecordRequest(route, start);
+        respond(std::move(response));
+    }
+
+    RequestHandler::ApiResponder RequestHandler::RecordOnResponse(metrics::Route route, std::chrono::steady_clock::time_point start, ApiResponder respond) const {
+        return [self = shared_from_this(), route, start, respond = std::move(respond)](ApiRequestResult&& result) {
+            self->RecordRequest(route, start);
+            respond(std::move(result));
+        };
+    }
 
-        content_type_ = response[http::field::content_type];
-        status_ = response.result_int();
+    void RequestHandler::RecordRequest(metrics::Route route, std::chrono::steady_clock::time_point start) const {
+        const auto latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        metrics::ServerMetrics& server_metrics = metrics::GetServerMetrics();
+        server_metrics.requests[static_cast<size_t>(route)].Inc();
+        server_metrics.request_latency[static_cast<size_t>(route)].Record(static_cast<uint64_t>(latency.count()));
+    }
+
+    // Every value comes from an atomic counter, so a scrape is served on the
+    // calling thread without going through the strands of the maps.
+    StringResponse RequestHandler::HandleMetricsRequest(const StringRequest& request) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!(request.method() == http::verb::get || request.method() == http::verb::head)) {
+            json::object json_response;
+            json_response["code"s] = "invalidMethod"s;
+            json_response["message"s] = "Only GET and HEAD methods are expected"s;
+            return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "GET, HEAD"s);
+        }
+
+        using metrics::TextWriter;
+        const metrics::ServerMetrics& server_metrics = metrics::GetServerMetrics();
+        TextWriter writer;
+
+        writer.WriteHelp("http_requests_total"sv, "counter"sv, "HTTP requests handled by route."sv);
+        for (size_t i = 0; i < metrics::ROUTE_COUNT; ++i) {
+            const auto route = TextWriter::Label("route"sv, metrics::GetRouteName(static_cast<metrics::Route>(i)));
+            writer.WriteSample("http_requests_total"sv, route, static_cast<double>(server_metrics.requests[i].Value()));
+        }
+        writer.WriteHelp("http_request_duration_seconds"sv, "histogram"sv, "Time to handle an HTTP request by route."sv);
+        for (size_t i = 0; i < metrics::ROUTE_COUNT; ++i) {
+            const auto route = TextWriter::Label("route"sv, metrics::GetRouteName(static_cast<metrics::Route>(i)));
+            writer.WriteHistogram("http_request_duration_seconds"sv, route, server_metrics.request_latency[i]);
+        }
+        writer.WriteHelp("http_sessions_active"sv, "gauge"sv, "Open HTTP connections."sv);
+        writer.WriteSample("http_sessions_active"sv, ""sv, static_cast<double>(server_metrics.http_sessions.Value()));
+        writer.WriteHelp("db_connection_wait_seconds"sv, "histogram"sv, "Time spent waiting for a database connection from the pool."sv);
+        writer.WriteHistogram("db_connection_wait_seconds"sv, ""sv, server_metrics.connection_wait);
+
+        writer.WriteHelp("game_players_online"sv, "gauge"sv, "Players in the session of a map as of its last tick."sv);
+        for (const auto& map : game_.GetMaps()) {
+            writer.WriteSample("game_players_online"sv, TextWriter::Label("map"sv, *map->GetId()),
+                static_cast<double>(app_.GetSessionMetrics(map->GetId()).players.Value()));
+        }
+        writer.WriteHelp("game_players_retired_total"sv, "counter"sv, "Players retired from the session of a map."sv);
+        for (const auto& map : game_.GetMaps()) {
+            writer.WriteSample("game_players_retired_total"sv, TextWriter::Label("map"sv, *map->GetId()),
+                static_cast<double>(app_.GetSessionMetrics(map->GetId()).retired.Value()));
+        }
+        writer.WriteHelp("game_loot_objects"sv, "gauge"sv, "Loot lying on a map as of its last tick."sv);
+        for (const auto& map : game_.GetMaps()) {
+            writer.WriteSample("game_loot_objects"sv, TextWriter::Label("map"sv, *map->GetId()),
+                static_cast<double>(app_.GetSessionMetrics(map->GetId()).loot.Value()));
+        }
+
+        const model::TickProfiler& profiler = app_.GetProfiler();
+        writer.WriteHelp("game_phase_duration_seconds"sv, "histogram"sv, "Duration of the phases of a session tick and of state saving."sv);
+        for (size_t i = 0; i < model::TickProfiler::PHASE_COUNT; ++i) {
+            const auto phase = static_cast<model::TickProfiler::Phase>(i);
+            writer.WriteHistogram("game_phase_duration_seconds"sv, TextWriter::Label("phase"sv, model::TickProfiler::GetPhaseName(phase)),
+                profiler.GetHistogram(phase));
+        }
+        writer.WriteHelp("game_tick_overruns_total"sv, "counter"sv, "Session ticks that took longer than the tick period."sv);
+        writer.WriteSample("game_tick_overruns_total"sv, ""sv, static_cast<double>(profiler.GetOverruns()));
+        writer.WriteHelp("game_snapshot_bytes"sv, "gauge"sv, "Size of the last saved state file."sv);
+        writer.WriteSample("game_snapshot_bytes"sv, ""sv, static_cast<double>(server_metrics.snapshot_bytes.Value()));
 
+        StringResponse response = MakeStringResponse(http::status::ok, writer.Release(), request.version(), request.keep_alive(), "text/plain; version=0.0.4"sv);
+        RecordRequest(metrics::Route::METRICS, start);
         return response;
     }
 
-    StringResponse RequestHandler::HandleApiRequestJoinGame(const StringRequest& request) {
+    void RequestHandler::HandleApiRequestJoinGame(const StringRequest& request, ApiResponder respond) {
         json::object json_response;
         std::string user_name;
         std::string mapId;
         if (request.method() != http::verb::post) {
             json_response["code"s] = "invalidMethod"s;
             json_response["message"s] = "Only POST method is expected"s;
-            return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s);
+            return respond(MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s));
         }
 
         try {
@@ -130,7 +227,7 @@ namespace http_handler {
             if (!json_body.as_object().contains("userName"s) || !json_body.as_object().contains("mapId")) {
                 json_response["code"s] = "invalidArgument"s;
                 json_response["message"s] = "Join game request parse error"s;
-                return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
             }
             user_name = json_body.as_object()["userName"s].as_string().data();
             mapId = json_body.as_object()["mapId"s].as_string().data();
@@ -138,29 +235,35 @@ namespace http_handler {
         catch (...) {
             json_response["code"s] = "invalidArgument"s;
             json_response["message"s] = "Join game request parse error"s;
-            return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+            return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
         }
         
         model::Map::Id map_Id(mapId);
         if (user_name.empty()) {
             json_response["code"s] = "invalidArgument"s;
             json_response["message"s] = "Invalid name"s;
-            return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+            return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
         } else if (!game_.FindMap(map_Id)) {
             json_response["code"s] = "mapNotFound"s;
             json_response["message"s] = "Map not found"s;
-            return MakeStringResponse(http::status::not_found, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+            return respond(MakeStringResponse(http::status::not_found, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
         }
 
         model::GameSession& game_session = game_.GetGameSession(*game_.FindMap(map_Id));
-        std::shared_ptr<model::Dog> dog = game_session.AddDog(user_name);
+        model::Dog dog = game_session.AddDog(user_name);
         
-        players_.Add(dog, game_session);
-        players::Token& token = player_tokens_.AddPlayer(players_.GetPlayers().back());
+        players::PlayerRef player = players_.Add(dog, game_session);
+        players::Token token = player_tokens_.AddPlayer(player);
+        app_.PublishSessionMetrics(game_session);
         json_response["authToken"s] = *token;
-        json_response["playerId"s] = players_.GetPlayers().back()->GetId();
-        
-        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+        json_response["playerId"s] = player.id;
+
+        // The token is checked against the snapshot, so it is handed out once the
+        // snapshot has the player.
+        app_.UpdateSnapshot(game_session, [response = MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv),
+                                           respond = std::move(respond)]() mutable {
+            respond(std::move(response));
+        });
     }
 
     StringResponse RequestHandler::HandleApiRequestGetMaps(const StringRequest& request) const {
@@ -188,7 +291,8 @@ namespace http_handler {
         return MakeStringResponse(http::status::ok, target, request.version(), request.keep_alive(), "application/json"sv);
     }
 
-    StringResponse RequestHandler::HandleApiRequestGetPlayers(const StringRequest& request) const {
+    // Served from the last snapshot of the map on the calling thread.
+    RequestHandler::ApiRequestResult RequestHandler::HandleApiRequestGetPlayers(const StringRequest& request) const {
         json::object json_response;
         if (!(request.method() == http::verb::head || request.method() == http::verb::get)) {
             json_response["code"s] = "invalidMethod"s;
@@ -205,29 +309,26 @@ namespace http_handler {
                 return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
             }
             players::Token token(request_token.substr(start + 1));
-            auto plr = player_tokens_.FindPlayerByToken(token);
-
-            
-            if (!plr || !plr->IsOnline()) {
+            auto ref = player_tokens_.FindPlayerByToken(token);
+            game_state::SnapshotPtr snapshot = ref ? app_.GetSnapshot(ref->map_id) : nullptr;
+            const game_state::PlayerState* player = snapshot ? snapshot->FindPlayer(ref->id) : nullptr;
+            if (!player || !player->online) {
                 json_response["code"s] = "unknownToken"s;
                 json_response["message"s] = "Player token has not been found"s;
                 return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
             }
-            json::object json_player;
-            for (auto& player : players_.GetPlayers()) {
-                json_player["name"s] = player->GetName();
-                json_response[std::to_string(player->GetId())] = json_player;
-            }
+            return MakeSharedStringResponse(http::status::ok, snapshot->GetPlayersBody(), request.version(), request.keep_alive(), "application/json"sv);
         }
         catch (...) {
             json_response["code"s] = "invalidToken"s;
             json_response["message"s] = "Authorization header is missing"s;
             return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
         }
-        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
     }
 
-    StringResponse RequestHandler::HandleApiRequestGameState(const StringRequest& request) const {
+    // Served from the last snapshot of the map on the calling thread: the request
+    // only checks the token and hands the shared body over.
+    RequestHandler::ApiRequestResult RequestHandler::HandleApiRequestGameState(const StringRequest& request) const {
         json::object json_response;
         if (!(request.method() == http::verb::head || request.method() == http::verb::get)) {
             json_response["code"s] = "invalidMethod"s;
@@ -235,6 +336,27 @@ namespace http_handler {
             return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "GET, HEAD"s);
         }
 
+        // A client that passes the tick of the last state it got only gets what
+        // changed after it.
+        std::optional<uint64_t> since;
+        const auto query_start = request.target().find_first_of('?');
+        if (query_start != std::string_view::npos) {
+            const auto query = request.target().substr(query_start + 1);
+            const auto param = query.find("since="sv);
+            if (param != std::string_view::npos && (param == 0 || query[param - 1] == '&')) {
+                const auto value_start = param + "since="sv.size();
+                const auto value = query.substr(value_start, query.find('&', value_start) - value_start);
+                uint64_t tick = 0;
+                const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), tick);
+                if (ec != std::errc{} || end != value.data() + value.size()) {
+                    json_response["code"s] = "invalidArgument"s;
+                    json_response["message"s] = "Invalid since tick"s;
+                    return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                }
+                since = tick;
+            }
+        }
+
         try {
             std::string request_token = { request[http::field::authorization].data(), request[http::field::authorization].size() };
             auto start = request_token.find_first_of(' ');
@@ -244,138 +366,165 @@ namespace http_handler {
                 return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
             }
             players::Token token(request_token.substr(start + 1));
-            auto plr = player_tokens_.FindPlayerByToken(token);
-            if (!plr || !plr->IsOnline()) {
+            auto ref = player_tokens_.FindPlayerByToken(token);
+            game_state::SnapshotPtr snapshot = ref ? app_.GetSnapshot(ref->map_id) : nullptr;
+            const game_state::PlayerState* player = snapshot ? snapshot->FindPlayer(ref->id) : nullptr;
+            if (!player || !player->online) {
                 json_response["code"s] = "unknownToken"s;
                 json_response["message"s] = "Player token has not been found"s;
                 return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
             }
-            json::object json_player;
-            json::object json_info;
-            for (auto& player : players_.GetPlayers()) {
-                if(*plr->GetGameSession().GetMap().GetId() != *player->GetGameSession().GetMap().GetId())
-                    continue;
-                    
-                model::Dog dog = player->GetDog();
-                model::Dog::Coords coords = dog.GetPosition();
-                json::array j_coords;
-                j_coords.push_back(json::value(coords.x));
-                j_coords.push_back(json::value(coords.y));
-                json_player["pos"s] = j_coords;
-                model::Dog::Speed speed = dog.GetSpeed();
-                json::array j_speed;
-                j_speed.push_back(json::value(speed.x));
-                j_speed.push_back(json::value(speed.y));
-                json_player["speed"s] = j_speed;
-                json_player["dir"s] = dog.GetDirection();
-                
-                json::array loot_in_bag;
-                for(auto& loot : dog.ReturnLoot()) {
-                    json::object loot_info;
-                    loot_info["id"] = loot->GetId();
-                    loot_info["type"] = loot->GetType();
-                    loot_in_bag.push_back(loot_info);
-                }
-                json_player["bag"] = loot_in_bag;
-                json_player["score"] = player->GetValue();
-
-                json_info[std::to_string(player->GetId())] = json_player;
-                
-            }
-            json_response["players"s] = json_info;
-
-            json::object json_lost_object;
-            json::object json_lost_object_info;
-            for (const auto& loot_object : game_.GetLootObjects()) {
-                if(!loot_object->IsVisible())
-                    continue;
-                
-                model::Dog::Coords coords = loot_object.get()->GetPosition();
-                json::array j_coords;
-                json_lost_object["type"] = json::value(loot_object.get()->GetType());
-                j_coords.push_back(json::value(coords.x));
-                j_coords.push_back(json::value(coords.y));
-                json_lost_object["pos"s] = j_coords;
-                json_lost_object_info[std::to_string(loot_object.get()->GetId())] = json_lost_object;
-            }
-            json_response["lostObjects"] = json_lost_object_info; 
+            const game_state::Encoding encoding = GetAcceptedEncoding(request);
+            game_state::StateBody body = since ? snapshot->GetStateBodySince(*since, encoding) : snapshot->GetStateBody(encoding);
+            const std::string_view content_type = encoding == game_state::Encoding::BINARY ? game_state::binary::CONTENT_TYPE : "application/json"sv;
+            return MakeSharedStringResponse(http::status::ok, std::move(body), request.version(), request.keep_alive(), content_type);
         }
         catch (...) {
             json_response["code"s] = "invalidToken"s;
             json_response["message"s] = "Authorization header is required"s;
             return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
         }
-        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
     }
 
-    StringResponse RequestHandler::HandleApiRequestGamePlayerAction(const StringRequest& request) const {
+    // Clients that list the binary state type in Accept get states in that form;
+    // everything else, errors included, stays JSON.
+    game_state::Encoding RequestHandler::GetAcceptedEncoding(const StringRequest& request) {
+        const std::string_view accept = request[http::field::accept];
+        return accept.find(game_state::binary::CONTENT_TYPE) != std::string_view::npos ? game_state::Encoding::BINARY : game_state::Encoding::JSON;
+    }
+
+    std::variant<players::PlayerRef, StringResponse> RequestHandler::FindStreamPlayer(const StringRequest& request) const {
+        json::object json_response;
+        auto stop = request.target().find_first_of('?');
+        if (request.target().substr(0, stop) != "/api/v1/game/stream"sv)
+            return MakeStringError(http::status::bad_request, request.version());
+
+        std::string request_token = { request[http::field::authorization].data(), request[http::field::authorization].size() };
+        auto start = request_token.find_first_of(' ');
+        if (start >= request_token.size() || !ValidToken(request_token)) {
+            json_response["code"s] = "invalidToken"s;
+            json_response["message"s] = "Authorization header is required"s;
+            return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+        }
+        auto ref = player_tokens_.FindPlayerByToken(players::Token(request_token.substr(start + 1)));
+        game_state::SnapshotPtr snapshot = ref ? app_.GetSnapshot(ref->map_id) : nullptr;
+        const game_state::PlayerState* player = snapshot ? snapshot->FindPlayer(ref->id) : nullptr;
+        if (!player || !player->online) {
+            json_response["code"s] = "unknownToken"s;
+            json_response["message"s] = "Player token has not been found"s;
+            return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+        }
+        return *ref;
+    }
+
+    // Runs on the strand of the player's map. A command is the body of an action
+    // request; a failed one is answered with an error frame.
+    void RequestHandler::HandleStreamCommand(const players::PlayerRef& ref, http_server::WebSocketSession& session, const std::string& message) {
+        json::object json_response;
+        players::Player* plr = players_.Find(ref);
+        if (!plr || !plr->IsOnline()) {
+            json_response["code"s] = "unknownToken"s;
+            json_response["message"s] = "Player token has not been found"s;
+            session.Send(std::make_shared<const std::string>(serialize(json_response)), false);
+            return;
+        }
+        try {
+            json::value json_body = json::parse(message);
+            std::string movement = json_body.as_object().at("move"s).as_string().c_str();
+            plr->GetDog().SetDirection(movement);
+        }
+        catch (...) {
+            json_response["code"s] = "invalidArgument"s;
+            json_response["message"s] = "Failed to parse command JSON"s;
+            session.Send(std::make_shared<const std::string>(serialize(json_response)), false);
+            return;
+        }
+        app_.UpdateSnapshot(plr->GetGameSession());
+    }
+
+    void RequestHandler::HandleApiRequestGamePlayerAction(const StringRequest& request, ApiResponder respond) const {
         json::object json_response;
         if (request.method() != http::verb::post) {
             json_response["code"s] = "invalidMethod"s;
             json_response["message"s] = "Invalid method"s;
-            return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s);
+            return respond(MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s));
         }
 
+        model::GameSession* game_session = nullptr;
         try {
             std::string request_token = { request[http::field::authorization].data(), request[http::field::authorization].size() };
             auto start = request_token.find_first_of(' ');
             if (start >= request_token.size() || !ValidToken(request_token)) {
                 json_response["code"s] = "invalidToken"s;
                 json_response["message"] = "Authorization header is required";
-                return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                return respond(MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
             }
             players::Token token(request_token.substr(start + 1));
-            auto plr = player_tokens_.FindPlayerByToken(token);
+            auto ref = player_tokens_.FindPlayerByToken(token);
+            players::Player* plr = ref ? players_.Find(*ref) : nullptr;
             if (!plr || !plr->IsOnline()) {
                 json_response["code"s] = "unknownToken"s;
                 json_response["message"s] = "Player token has not been found"s;
-                return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                return respond(MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
             }
             if (request[http::field::content_type] != "application/json"s) {
                 json_response["code"s] = "invalidArgument"s;
                 json_response["message"s] = "Invalid content type"s;
-                return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
             }
             json::value json_body = json::parse(request.body());
             std::string movement = { json_body.as_object()["move"s].as_string().data(), json_body.as_object()["move"].as_string().size() };
             plr->GetDog().SetDirection(movement);
+            game_session = &plr->GetGameSession();
         }
         catch (...) {
             json_response["code"s] = "invalidToken"s;
             json_response["message"] = "Authorization header is required"s;
-            return MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+            return respond(MakeStringResponse(http::status::unauthorized, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
         }
 
-
-        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+        app_.UpdateSnapshot(*game_session, [response = MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv),
+                                            respond = std::move(respond)]() mutable {
+            respond(std::move(response));
+        });
     }
 
-    StringResponse RequestHandler::HandleApiRequestGameTick(const StringRequest& request) {
+    // Runs on the application strand. The snapshots that state and players are
+    // read from are published by the strands of the maps, so the response only
+    // goes out once every map has applied the tick.
+    void RequestHandler::HandleApiRequestGameTick(const StringRequest& request, ApiResponder respond) {
         json::object json_response;
         if (request.method() != http::verb::post) {
             json_response["code"] = "invalidMethod"s;
             json_response["message"] = "Invalid method"s;
-            return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s);
+            return respond(MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "POST"s));
         }
 
+        int64_t time = 0;
         try {
             if (request[http::field::content_type] != "application/json"s) {
                 json_response["code"s] = "invalidArgument"s;
                 json_response["message"] = "Failed to parse tick request JSON"s;
-                return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+                return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
             }
             json::value json_body = json::parse(request.body());
-            int time = json_body.as_object()["timeDelta"s].as_int64();
-            game_.GenerateLoot(std::chrono::duration_cast<std::chrono::milliseconds>(time * 1.0ms));
-            UpdateGameState(time);
+            time = json_body.as_object()["timeDelta"s].as_int64();
+            if (time < 0) {
+                json_response["code"s] = "invalidArgument"s;
+                json_response["message"] = "timeDelta must not be negative"s;
+                return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
+            }
         }
         catch (...) {
             json_response["code"s] = "invalidArgument"s;
             json_response["message"] = "Failed to parse tick request JSON"s;
-            return MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+            return respond(MakeStringResponse(http::status::bad_request, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv));
         }
 
-        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+        app_.Tick(std::chrono::milliseconds(time), [response = MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv),
+                                                    respond = std::move(respond)]() mutable {
+            respond(std::move(response));
+        });
     }
 
     StringResponse RequestHandler::HandleApiRequestGameRecords(const StringRequest& request) {
@@ -432,6 +581,38 @@ namespace http_handler {
         return MakeStringResponse(http::status::ok, serialize(json_info), request.version(), request.keep_alive(), "application/json"sv);
     }
 
+    StringResponse RequestHandler::HandleApiRequestTickProfile(const StringRequest& request) const {
+        json::object json_response;
+        if (!(request.method() == http::verb::get || request.method() == http::verb::head)) {
+            json_response["code"s] = "invalidMethod"s;
+            json_response["message"s] = "Only GET and HEAD methods are expected"s;
+            return MakeStringResponseAllowed(http::status::method_not_allowed, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv, "GET, HEAD"s);
+        }
+
+        // The profiler only holds atomic counters, so it is read here without
+        // going through any strand.
+        const model::TickProfiler& profiler = app_.GetProfiler();
+        const double ns_in_us = 1000.0;
+        json::object phases;
+        for (size_t i = 0; i < model::TickProfiler::PHASE_COUNT; ++i) {
+            const auto phase = static_cast<model::TickProfiler::Phase>(i);
+            const util::LatencyHistogram& histogram = profiler.GetHistogram(phase);
+            json::object json_phase;
+            json_phase["count"s] = histogram.Count();
+            json_phase["meanUs"s] = histogram.Mean() / ns_in_us;
+            json_phase["p50Us"s] = histogram.ValueAtPercentile(50.0) / ns_in_us;
+            json_phase["p90Us"s] = histogram.ValueAtPercentile(90.0) / ns_in_us;
+            json_phase["p99Us"s] = histogram.ValueAtPercentile(99.0) / ns_in_us;
+            json_phase["maxUs"s] = histogram.Max() / ns_in_us;
+            phases[model::TickProfiler::GetPhaseName(phase)] = std::move(json_phase);
+        }
+        json_response["tickPeriodMs"s] = profiler.GetTickPeriod().count();
+        json_response["overruns"s] = profiler.GetOverruns();
+        json_response["phases"s] = std::move(phases);
+
+        return MakeStringResponse(http::status::ok, serialize(json_response), request.version(), request.keep_alive(), "application/json"sv);
+    }
+
     StringResponse RequestHandler::MakeStringError(http::status status, unsigned http_version) const {
         return MakeStringError(status, http_version, "application/json"s);
     }
@@ -454,10 +635,10 @@ namespace http_handler {
     std::string RequestHandler::ConvertMapsToString() const {
         json::array target;
 
-        for (auto map : game_.GetMaps()) {
+        for (const auto& map : game_.GetMaps()) {
             json::object json_map;
-            json_map["id"s] = *map.GetId();
-            json_map["name"s] = map.GetName();
+            json_map["id"s] = *map->GetId();
+            json_map["name"s] = map->GetName();
             target.push_back(json_map);
 
         }
@@ -537,148 +718,31 @@ namespace http_handler {
         return true;
     }
 
-    void RequestHandler::UpdateGameState(int time) {
-        int msc_in_sec = 1000;
-        game_.AddTime(1.0 * time / msc_in_sec);
-        const double timer = game_.GetTimer();
-        if(!save_path_.empty() && save_period_ != 0 && prev_saving_ < timer * msc_in_sec - save_period_) {
-            serializer::SerializeGame(save_path_, game_, players_, player_tokens_);
-            prev_saving_ = timer * msc_in_sec;
-        }
-        const double retirement_time = game_.GetRetirementTime();
-        for (auto& player : players_.GetPlayers()) {
-            
-            auto game_session = player->GetGameSession();
-            game_session.RefreshTimer(timer);
-            auto& dog = player->GetDog();
-            dog.RefreshTime(1.0 * time / msc_in_sec);
-
-            if(!player->IsOnline())
-                continue;
-
-            auto position = dog.GetPosition();
-            int x = std::round(position.x);
-            int y = std::round(position.y);
-
-            double speed_x = dog.GetSpeed().x;
-            double speed_y = dog.GetSpeed().y;
-            auto roads = game_session.GetMap().GetRoadMap({ x, y });
-            bool needed_to_stop = false;
-
-            double expected_x = position.x + speed_x * time / msc_in_sec;
-            double current_x = position.x;
-            double expected_y = position.y + speed_y * time / msc_in_sec;
-            double current_y = position.y;
-
-            const double ROAD_WIDTH = 0.8;
-            if (speed_x - std::numeric_limits<double>::epsilon() > 0) {
-                for (const auto& road : roads) {
-                    double possible_x_max = std::max(road->GetStart().x, road->GetEnd().x) * 1.0 + ROAD_WIDTH / 2;
-                    if (expected_x > possible_x_max + std::numeric_limits<double>::epsilon() && expected_x > current_x + std::numeric_limits<double>::epsilon()) {
-                        current_x = std::max(current_x, possible_x_max);
-                        needed_to_stop = true;
-                    }
-                    else if (expected_x > current_x + std::numeric_limits<double>::epsilon()) {
-                        current_x = expected_x;
-                        needed_to_stop = false;
-                    }
-                }
-            }
-            else if (speed_x + std::numeric_limits<double>::epsilon() < 0) {
-                for (const auto& road : roads) {
-                    double possible_x_min = std::min(road->GetStart().x, road->GetEnd().x) * 1.0 - ROAD_WIDTH / 2;
-                    if (expected_x < possible_x_min - std::numeric_limits<double>::epsilon() && expected_x < current_x - std::numeric_limits<double>::epsilon()) {
-                        current_x = std::min(current_x, possible_x_min);
-                        needed_to_stop = true;
-                    }
-                    else if (expected_x < current_x - std::numeric_limits<double>::epsilon()) {
-                        current_x = expected_x;
-                        needed_to_stop = false;
-                    }
-                }
-            } else if (speed_y - std::numeric_limits<double>::epsilon() > 0) {
-                for (const auto& road : roads) {
-                    double possible_y_max = std::max(road->GetStart().y, road->GetEnd().y) * 1.0 + ROAD_WIDTH / 2;
-                    if (expected_y > possible_y_max + std::numeric_limits<double>::epsilon() && expected_y > current_y + std::numeric_limits<double>::epsilon()) {
-                        current_y = std::max(current_y, possible_y_max);
-                        needed_to_stop = true;
-                    }
-                    else if (expected_y > current_y + std::numeric_limits<double>::epsilon()) {
-                        current_y = expected_y;
-                        needed_to_stop = false;
-                    }
-                }
-            }
-            else if (speed_y + std::numeric_limits<double>::epsilon() < 0) {
-                for (const auto& road : roads) {
-                    double possible_y_min = std::min(road->GetStart().y, road->GetEnd().y) * 1.0 - ROAD_WIDTH / 2;
-                    if (expected_y < possible_y_min - std::numeric_limits<double>::epsilon() && expected_y < current_y - std::numeric_limits<double>::epsilon()) {
-                        current_y = std::min(current_y, possible_y_min);
-                        needed_to_stop = true;
-                    }
-                    else if (expected_y < current_y - std::numeric_limits<double>::epsilon()) {
-                        current_y = expected_y;
-                        needed_to_stop = false;
-                    }
-                }
-            }
-            
-            if(dog.GetRetirementTime() > retirement_time || std::abs(dog.GetRetirementTime() - retirement_time) < std::numeric_limits<double>::epsilon()) {
-                player->SetOffline();
-                game_session.AddRetiredOne();
-                {
-                    auto conn = conn_pool_.GetConnection();
-                    pqxx::work work{*conn};
-                    double total_time = (dog.GetCurrentTime() - dog.GetStartTime());
-                    work.exec_params("INSERT INTO retired_players (id, name, score, play_time_ms) VALUES ($1, $2, $3, $4)"_zv, 
-                        dog.GetUUID().ToString(), dog.GetName(), player->GetValue(), total_time);
-                    work.commit();
-                }
-            }
-
-            if (needed_to_stop)
-                dog.Stop();
-
-            player->GetDog().SetPosition(current_x, current_y);
-        }
-
-
-
-        collision_detector::LootGathererProvider provider(game_, players_);
-        std::vector<collision_detector::GatheringEvent> events = FindGatherEvents(provider);
-        for(const auto& event : events) {
-            int item_id = game_.GetLootObjects().at(event.item_id)->GetId();
-            for(auto& game_session : game_.GetGameSessions()) {
-                if(!game_session.second.GetLootObjects().contains(item_id)) {
-                    continue;  
-                }
-                auto& loot = game_session.second.GetLootObjects()[item_id];
-                if(players_.GetPlayers()[event.gatherer_id]->GetDog().TakeLoot(loot)) {
-                    game_.GetLootObjects().at(event.item_id)->SetInvisible();
-                    game_session.second.DeleteLootObject(item_id);
-                }
-                
-                break;
+    RequestHandler::Strand* RequestHandler::FindApiStrand(const StringRequest& request) {
+        auto stop = request.target().find_first_of('?');
+        std::string api_request = std::string(request.target().substr(0, stop));
+        if (api_request == "/api/v1/game/join"s) {
+            try {
+                json::value json_body = json::parse(request.body());
+                model::Map::Id map_id(std::string(json_body.as_object().at("mapId"s).as_string().data()));
+                if (game_.FindMap(map_id))
+                    return &app_.GetSessionStrand(map_id);
             }
-        }
-
-        collision_detector::OfficeGathererProvider office_provider(game_, players_);
-        std::vector<collision_detector::GatheringEvent> office_events = FindGatherEvents(office_provider);
-
-        for(const auto& event : office_events) {
-            for(auto& game_session : game_.GetGameSessions()) {
-                if(game_session.second.GetDogs().size() != players_.GetPlayers()[event.gatherer_id]->GetGameSession().GetDogs().size()) {
-                    continue;
-                }
-                model::Dog& dog = players_.GetPlayers()[event.gatherer_id]->GetDog();
-                for(auto& loot : dog.ReturnLoot()) {
-                    json::value parsed_game_data = json::parse(game_.GetJsonMap(game_session.second.GetMap().GetId()));
-                    int loot_value = parsed_game_data.as_object()["lootTypes"].as_array()[loot->GetType()].as_object()["value"].as_int64();
-                    players_.GetPlayers()[event.gatherer_id]->AddValue(loot_value);
-                }
+            catch (...) {
             }
-
-            break;
+            return nullptr;
         }
+        // Players and state are read from snapshots and need no strand.
+        if (api_request == "/api/v1/game/player/action"s) {
+            std::string request_token = { request[http::field::authorization].data(), request[http::field::authorization].size() };
+            auto start = request_token.find_first_of(' ');
+            if (start >= request_token.size())
+                return nullptr;
+            auto player = player_tokens_.FindPlayerByToken(players::Token(request_token.substr(start + 1)));
+            return player ? &app_.GetSessionStrand(player->map_id) : nullptr;
+        }
+        if (api_request == "/api/v1/game/tick"s)
+            return &app_.GetStrand();
+        return nullptr;
     }
 }  // namespace http_handler
@@ -1,9 +1,12 @@
 #pragma once
 
+#include "application.h"
 #include "db_connection.h"
 #include "http_server.h"
+#include "metrics.h"
 #include "model.h"
 #include "player.h"
+#include "shared_string_body.h"
 #include "util/tagged.h"
 
 #include <boost/asio/io_context.hpp>
@@ -12,6 +15,7 @@
 #include <boost/json.hpp>
 
 
+#include <chrono>
 #include <filesystem>
 #include <functional>
 #include <memory>
@@ -23,6 +27,7 @@ namespace beast = boost::beast;
 namespace fs = std::filesystem;
 namespace http = beast::http;
 namespace json = boost::json;
+namespace websocket = beast::websocket;
 namespace net = boost::asio; 
 namespace sys = boost::system;
 
@@ -87,22 +92,21 @@ namespace http_handler {
     using StringResponse = http::response<http::string_body>;
     using FileResponse = http::response<http::file_body>;
     using EmptyResponse = http::response<http::string_body>;
+    using SharedStringResponse = http::response<http_server::SharedStringBody>;
 
     class RequestHandler : public std::enable_shared_from_this<RequestHandler> {
     public:
         using Strand = net::strand<net::io_context::executor_type>;
 
-        RequestHandler(fs::path root, Strand api_strand, model::Game& game, players::Players& players, players::PlayerTokens& tokens, 
-                        int tick_period, conn_pool::ConnectionPool& conn_pool, int save_period, std::string save_path)
+        RequestHandler(fs::path root, application::Application& app, model::Game& game, players::Players& players, players::PlayerTokens& tokens, 
+                        int tick_period, conn_pool::ConnectionPool& conn_pool)
             : root_{ std::move(root) }
-            , api_strand_{ api_strand }
+            , app_{ app }
             , game_{ game }
             , players_{ players }
             , player_tokens_{ tokens }
             , tick_period_{ tick_period } 
             , conn_pool_{conn_pool}
-            , save_period_{save_period}
-            , save_path_{save_path}
         {
         }
 
@@ -110,65 +114,120 @@ namespace http_handler {
         RequestHandler& operator=(const RequestHandler&) = delete;
 
         template <typename Body, typename Allocator, typename Send>
-        std::pair<int, std::string> operator()(tcp::endpoint ep, http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
+        void operator()(tcp::endpoint ep, http::request<Body, http::basic_fields<Allocator>>&& req, Send&& send) {
             auto version = req.version();
             auto keep_alive = req.keep_alive();
             const int minimum_get_request_size = 5;
 
-            if (req.target() == "/favicon.ico"sv) return GetLogInfo();
+            if (req.target() == "/favicon.ico"sv) return;
 
             try {
+                if (websocket::is_upgrade(req)) {
+                    HandleStreamUpgrade(std::move(req), send);
+                    return;
+                }
+                if (req.target() == "/metrics"sv) {
+                    send(HandleMetricsRequest(req));
+                    return;
+                }
                 if (req.target().substr(0, minimum_get_request_size) == "/api/"sv) {
+                    Strand* strand = FindApiStrand(req);
                     auto handle = [self = shared_from_this(), send,
                         req = std::forward<decltype(req)>(req), version, keep_alive] {
                         try {
-                            // Этот assert не выстрелит, так как лямбда-функция будет выполняться внутри strand
-                            assert(self->api_strand_.running_in_this_thread());
-                            send(self->HandleApiRequest(req));
-                            return self->GetLogInfo();
+                            self->HandleApiRequest(req, [send](ApiRequestResult&& result) {
+                                std::visit(
+                                    [&send](auto&& response) {
+                                        send(std::forward<decltype(response)>(response));
+                                    },
+                                    std::move(result));
+                            });
                         }
                         catch (...) {
                             send(self->ReportServerError(version, keep_alive));
                         }
                     };
-                    net::dispatch(api_strand_, handle);
-                    return GetLogInfo();
+                    // Requests that change a session run on the strand of its map; reads,
+                    // which go to the published snapshots, and requests that touch no
+                    // session are handled right away on the calling thread.
+                    if (strand)
+                        net::dispatch(*strand, handle);
+                    else
+                        handle();
+                    return;
                 }
+                const auto start = std::chrono::steady_clock::now();
                 std::visit(
                     [&send](auto&& result) {
                         send(std::forward<decltype(result)>(result));
                     },
                     HandleFileRequest(req));
-                return GetLogInfo();
+                RecordRequest(metrics::Route::STATIC, start);
             }
             catch (...) {
                 send(ReportServerError(version, keep_alive));
             }
-            return GetLogInfo();
         }
 
-        std::pair<int, std::string> GetLogInfo() {
-            return { status_, content_type_ };
+        // A WebSocket on /api/v1/game/stream carries the state of the player's map to
+        // the client after every tick and movement commands back. Commands run on
+        // the strand of the map like the action requests.
+        template <typename Request, typename Send>
+        void HandleStreamUpgrade(Request&& req, Send& send) {
+            const auto start = std::chrono::steady_clock::now();
+            auto player = FindStreamPlayer(req);
+            if (auto* error = std::get_if<StringResponse>(&player)) {
+                send(std::move(*error));
+                RecordRequest(metrics::Route::STREAM, start);
+                return;
+            }
+            const players::PlayerRef ref = std::get<players::PlayerRef>(std::move(player));
+            // The request is handed over to the WebSocket session below.
+            const game_state::Encoding encoding = GetAcceptedEncoding(req);
+
+            auto ws = send.AcceptWebSocket(std::move(req), [self = shared_from_this(), ref](http_server::WebSocketSession& session, std::string message) {
+                net::post(self->app_.GetSessionStrand(ref.map_id), [self, ref, session = session.shared_from_this(), message = std::move(message)] {
+                    self->HandleStreamCommand(ref, *session, message);
+                });
+            });
+            // The sink expires as soon as the connection closes, so the next push
+            // unsubscribes it.
+            net::post(app_.GetSessionStrand(ref.map_id), [self = shared_from_this(), map_id = ref.map_id, weak = std::weak_ptr(ws), encoding] {
+                self->app_.Subscribe(map_id, game_state::MakeStreamSink(weak, encoding));
+            });
+            RecordRequest(metrics::Route::STREAM, start);
         }
 
     private:
         using FileRequestResult = std::variant<EmptyResponse, StringResponse, FileResponse>;
+        using ApiRequestResult = std::variant<StringResponse, SharedStringResponse>;
+        // Sends the response to an API request. Most requests are answered before
+        // HandleApiRequest returns; a tick is answered once every map has applied it.
+        using ApiResponder = std::function<void(ApiRequestResult&& result)>;
 
         FileRequestResult HandleFileRequest(const StringRequest& req);
-        StringResponse HandleApiRequest(const StringRequest& request);
+        void HandleApiRequest(const StringRequest& request, ApiResponder respond);
         StringResponse MakeStringError(http::status, unsigned) const;
         StringResponse MakeStringError(http::status, unsigned, std::string_view) const;
-        StringResponse ReportServerError(unsigned version, bool keep_alive);
+        StringResponse ReportServerError(unsigned version, bool keep_alive) const;
         StringResponse MakeStringResponse(http::status, std::string_view, unsigned, bool, std::string_view) const;
         StringResponse MakeStringResponseAllowed(http::status, std::string_view, unsigned, bool, std::string_view, std::string) const;
-        StringResponse HandleApiRequestJoinGame(const StringRequest& request);
+        SharedStringResponse MakeSharedStringResponse(http::status, std::shared_ptr<const std::string>, unsigned, bool, std::string_view) const;
+        void HandleApiRequestJoinGame(const StringRequest& request, ApiResponder respond);
         StringResponse HandleApiRequestGetMaps(const StringRequest& reqeust) const;
         StringResponse HandleApiRequestGetMap(const StringRequest& request) const;
-        StringResponse HandleApiRequestGetPlayers(const StringRequest& request) const;
-        StringResponse HandleApiRequestGameState(const StringRequest& request) const;
-        StringResponse HandleApiRequestGamePlayerAction(const StringRequest& request) const;
-        StringResponse HandleApiRequestGameTick(const StringRequest& request);
+        ApiRequestResult HandleApiRequestGetPlayers(const StringRequest& request) const;
+        ApiRequestResult HandleApiRequestGameState(const StringRequest& request) const;
+        void HandleApiRequestGamePlayerAction(const StringRequest& request, ApiResponder respond) const;
+        void HandleApiRequestGameTick(const StringRequest& request, ApiResponder respond);
         StringResponse HandleApiRequestGameRecords(const StringRequest& request);
+        StringResponse HandleApiRequestTickProfile(const StringRequest& request) const;
+        StringResponse HandleMetricsRequest(const StringRequest& request);
+        std::variant<players::PlayerRef, StringResponse> FindStreamPlayer(const StringRequest& request) const;
+        static game_state::Encoding GetAcceptedEncoding(const StringRequest& request);
+        void HandleStreamCommand(const players::PlayerRef& ref, http_server::WebSocketSession& session, const std::string& message);
+        void RecordRequest(metrics::Route route, std::chrono::steady_clock::time_point start) const;
+        ApiResponder RecordOnResponse(metrics::Route route, std::chrono::steady_clock::time_point start, ApiResponder respond) const;
         
 
         std::string ConvertMapsToString() const;
@@ -176,20 +235,15 @@ namespace http_handler {
         std::string GetFileType(beast::string_view body) const;
         bool IsSubPath(fs::path path) const;
         bool ValidToken(const std::string& token) const;
-        void UpdateGameState(int time);
+        Strand* FindApiStrand(const StringRequest& request);
 
         fs::path root_;
-        Strand api_strand_;
+        application::Application& app_;
         model::Game& game_;
         players::Players& players_;
         players::PlayerTokens& player_tokens_;
         int tick_period_;
         conn_pool::ConnectionPool& conn_pool_;
-        int save_period_ = 0;
-        int prev_saving_ = 100;
-        std::string save_path_;
-        int status_ = 200;
-        std::string content_type_ = "application/json"s;
         /* прочие данные */
 
         struct ContentType {
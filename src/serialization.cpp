@@ -4,13 +4,11 @@ namespace model {
     [[nodiscard]] LootObject LootSerializer::Restore() const {
         LootObject loot{id_, type_};
         loot.SetPosition(coords_);
-        if(!visible_) 
-            loot.SetInvisible();
         return loot;
     }
 
 
-    void DogSerializer::Restore(Dog& dog, std::vector<std::shared_ptr<LootObject>> loot_objects) const {
+    void DogSerializer::Restore(Dog& dog) const {
         dog.SetName(name_);
         dog.SetCoords(coords_);
         dog.SetStartCoords(start_coords_);
@@ -21,50 +19,48 @@ namespace model {
         dog.SetStartTime(start_time_);
         dog.SetCurrentTime(current_time_);
         dog.SetUUID(uuid_);
-        for(const auto& loot : loot_ids_) {
-            dog.TakeLoot(loot_objects[loot]);
+        for(const auto& loot : bag_) {
+            dog.TakeLoot(loot.Restore());
         }
     }
 
 
-    void GameSessionSerializer::Restore(GameSession& game_session, const std::vector<std::shared_ptr<LootObject>> loot_objects) const {
+    void GameSessionSerializer::Restore(GameSession& game_session) const {
         game_session.SetRetiredNumber(retired_);
+        game_session.SetLootNumber(loot_number_);
+        game_session.SetFreeLootIds(free_loot_ids_);
 
-        for(int id : loot_ids_)
-            game_session.AddNewLoot(loot_objects[id], id);
+        for(const auto& loot : loot_objects_) 
+            game_session.AddLootObject(loot.Restore());
     }
 
 
     void GameSerializer::Restore(Game& game) const {
         game.SetTimer(timer_);
-        game.SetLootNumber(loot_number_);
-
-        std::vector<std::shared_ptr<LootObject>> loot_objects;
-        for(const auto& loot : loot_objects_) {
-            loot_objects.push_back(std::make_shared<LootObject>(loot.Restore()));
-        }
-        game.SetLootObjects(loot_objects);
     }
 }  // namespace model
 
 namespace players {
 
 
-    void PlayerSerializer::Restore(Players& players, model::Game& game) const {
-        model::Map::Id map_id(map_id_);
-        model::GameSession& game_session = game.GetGameSession(*game.FindMap(map_id));
-        std::shared_ptr<model::Dog> dog = game_session.AddDog(name_);
-        players.Add(dog, game_session);
-        auto player = players.GetPlayers().back();
+    PlayerRef PlayerSerializer::Restore(Players& players, model::GameSession& game_session) const {
+        model::Dog dog = game_session.AddDog(name_);
+        PlayerRef ref = players.Add(dog, game_session, id_);
+        Player* player = players.Find(ref);
         player->AddValue(value_);
         if(!online_) 
             player->SetOffline();
+        return ref;
     }
 
-    void TokensSerializer::Restore(PlayerTokens& tokens, const std::vector<std::shared_ptr<Player>>& players) const {
+    void TokensSerializer::Restore(PlayerTokens& tokens, const std::unordered_map<int, PlayerRef>& players) const {
         for(int i = 0; i < tokens_.size(); ++i) {
+            // The tokens are captured after the sessions, so a player who joined
+            // in between has a token but no saved state.
+            if(!players.contains(players_[i]))
+                continue;
             Token token{tokens_[i]};
-            tokens.AddPlayerWithToken(token, players[players_[i]]);
+            tokens.AddPlayerWithToken(token, players.at(players_[i]));
         }
     }
 
@@ -72,34 +68,50 @@ namespace players {
 namespace serializer {
 
         
+    void SessionSerializer::Restore(model::Game& game, players::Players& players) const {
+        model::Map::Id map_id(map_id_);
+        const model::Map* map = game.FindMap(map_id);
+        if(!map)
+            return;
+
+        model::GameSession& game_session = game.GetGameSession(*map);
+        game_session_.Restore(game_session);
+        for(size_t i = 0; i < players_.size(); ++i) {
+            auto ref = players_[i].Restore(players, game_session);
+            dogs_[i].Restore(players.Find(ref)->GetDog());
+        }
+    }
+
     void ApplicationSerializer::Restore(model::Game& game, players::Players& players, players::PlayerTokens& tokens) const {
         game_.Restore(game);
-        for(const auto& player: players_) {
-            player.Restore(players, game);
-        }
-        
+
+        for(const auto& session : sessions_) 
+            session.Restore(game, players);
+
+        std::unordered_map<int, players::PlayerRef> players_by_id;
         for(const auto& map : game.GetMaps()) {
-            model::Map::Id map_id = map.GetId();
-            int id = 0;
-            if(game.GetGameSessions().contains(map_id))
-                game_sessions_[id++].Restore(game.GetGameSessions()[map_id], game.GetLootObjects());
+            const auto& map_id = map->GetId();
+            players.GetPlayers(map_id).ForEach([&](players::PlayerHandle handle, const players::Player& player) {
+                players_by_id.insert_or_assign(player.GetId(), players::PlayerRef{map_id, handle, player.GetId()});
+            });
         }
+        
+        tokens_.Restore(tokens, players_by_id);
+    }
 
-        for(size_t i = 0; i < players.GetPlayers().size(); i++) {
-            dogs_[i].Restore(players.GetPlayers()[i]->GetDog(), game.GetLootObjects());
+    void SerializeGame(const std::string& path, const ApplicationSerializer& app_serializer) {
+        std::string tmp_path = path + "_tmp";
+        {
+            std::ofstream out(tmp_path, std::ios_base::binary);
+            boost::archive::binary_oarchive ar{out};
+            ar << app_serializer;
         }
-        
-        tokens_.Restore(tokens, players.GetPlayers());
+        std::filesystem::rename(tmp_path, path);
     }
 
     void SerializeGame(const std::string& path, const model::Game& game, 
                         const players::Players& players, const players::PlayerTokens& tokens) {
-        std::string tmp_path = path + "_tmp";
-        std::ofstream out(tmp_path, std::ios_base::binary);
-        boost::archive::binary_oarchive ar{out};
-        ApplicationSerializer app_serializer(game, players, tokens);
-        ar << app_serializer;
-        std::filesystem::rename(tmp_path, path);
+        SerializeGame(path, ApplicationSerializer(game, players, tokens));
     }
 
     void DeserializeGame(std::string& path, model::Game& game, 
@@ -108,7 +120,7 @@ namespace serializer {
             return;
         std::ifstream in(path, std::ios_base::binary);
         boost::archive::binary_iarchive ar{in};
-        ApplicationSerializer app_serializer(game, players, tokens);
+        ApplicationSerializer app_serializer;
         ar >> app_serializer;
         app_serializer.Restore(game, players, tokens);
     }
@@ -37,8 +37,7 @@ namespace model {
         explicit LootSerializer(const LootObject& loot) 
             : id_(loot.GetId())
             , type_(loot.GetType())
-            , coords_(loot.GetPosition())
-            , visible_(loot.IsVisible()) {
+            , coords_(loot.GetPosition()) {
         }
 
         [[nodiscard]] LootObject Restore() const;
@@ -48,22 +47,18 @@ namespace model {
             ar& id_;
             ar& type_;
             ar& coords_;
-            ar& visible_;
         }
 
     private:
         int id_;
         int type_;
         Dog::Coords coords_;
-        bool visible_;
     };
 
     class DogSerializer {
     public:
         DogSerializer() = default;
 
-        using Bag = std::vector<std::shared_ptr<LootObject>>;
-
         explicit DogSerializer(const Dog& dog) 
                 : name_(dog.GetName()) 
                 , nominal_speed_(dog.GetNominalSpeed())
@@ -78,11 +73,11 @@ namespace model {
                 , uuid_(dog.GetUUID().ToString()) {
 
             for(const auto& loot : dog.GetBag()) {
-                loot_ids_.push_back(loot->GetId());
+                bag_.push_back(LootSerializer(loot));
             }
         }
 
-        void Restore(Dog& dog, std::vector<std::shared_ptr<LootObject>> loot_objects) const;
+        void Restore(Dog& dog) const;
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
@@ -98,7 +93,7 @@ namespace model {
             ar& start_time_;
             ar& current_time_;
             ar& uuid_;
-            ar& loot_ids_;
+            ar& bag_;
         }
 
     private:
@@ -114,7 +109,7 @@ namespace model {
         double start_time_ = 0.0;
         double current_time_ = 0.0;
         std::string uuid_;
-        std::vector<int> loot_ids_;
+        std::vector<LootSerializer> bag_;
     };
 
     class GameSessionSerializer {
@@ -122,37 +117,37 @@ namespace model {
         GameSessionSerializer() = default;
 
         explicit GameSessionSerializer(const GameSession& game_session) 
-                : retired_(game_session.GetRetired()) {
+                : retired_(game_session.GetRetired())
+                , loot_number_(game_session.GetLootNumber())
+                , free_loot_ids_(game_session.GetFreeLootIds()) {
 
             for(const auto& loot : game_session.GetLootObjects()) 
-                loot_ids_.push_back(loot.second->GetId());
+                loot_objects_.push_back(LootSerializer(loot));
         }
 
-        void Restore(GameSession& game_session, const std::vector<std::shared_ptr<LootObject>> loot_objects) const;
+        void Restore(GameSession& game_session) const;
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
             ar& retired_;
-            ar& loot_ids_;
+            ar& loot_number_;
+            ar& free_loot_ids_;
+            ar& loot_objects_;
         }
 
     private:
         int retired_;
-        std::vector<int> loot_ids_;
+        int loot_number_;
+        std::vector<int> free_loot_ids_;
+        std::vector<LootSerializer> loot_objects_;
     };
 
     class GameSerializer {
     public:
         GameSerializer() = default;
 
-        using Bag = std::vector<std::shared_ptr<LootObject>>;
-
         explicit GameSerializer(const Game& game) 
-                : timer_(game.GetTimer())
-                , loot_number_(game.GetLootNumber()) {
-
-            for(const auto& loot : game.GetLootObjects())
-                loot_objects_.push_back(LootSerializer(*loot));
+                : timer_(game.GetTimer()) {
         }
 
         void Restore(Game& game) const;
@@ -160,14 +155,10 @@ namespace model {
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
             ar& timer_;
-            ar& loot_number_;
-            ar& loot_objects_;
         }
 
     private:
         double timer_;
-        int loot_number_;
-        std::vector<LootSerializer> loot_objects_;
     };
 } // namespace model 
 
@@ -176,24 +167,24 @@ namespace players {
     public:
         PlayerSerializer() = default;
         PlayerSerializer(const Player& player) 
-                : map_id_(player.GetMapId())
+                : id_(player.GetId())
                 , name_(player.GetName())
                 , value_(player.GetValue())
                 , online_(player.IsOnline()) {
         }
 
-        void Restore(Players& players, model::Game& game) const;
+        PlayerRef Restore(Players& players, model::GameSession& game_session) const;
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
-            ar& map_id_;
+            ar& id_;
             ar& name_;
             ar& value_;
             ar& online_;
         }
 
     private:
-        std::string map_id_;
+        int id_;
         std::string name_;
         int value_;
         bool online_;
@@ -207,11 +198,11 @@ namespace players {
             for(auto token : tokens.GetTokens()) {
                 tokens_.push_back(*token);
                 if(tokens.GetPlayerByToken(token)) 
-                    players_.push_back(tokens.GetPlayerByToken(token)->GetId());
+                    players_.push_back(tokens.GetPlayerByToken(token)->id);
             }
         }
 
-        void Restore(PlayerTokens& tokens, const std::vector<std::shared_ptr<Player>>& players) const;
+        void Restore(PlayerTokens& tokens, const std::unordered_map<int, PlayerRef>& players) const;
 
         template <typename Archive>
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
@@ -229,6 +220,40 @@ namespace players {
 
 namespace serializer {
 
+    // State of a single map: its session together with the players who joined it.
+    // It only reads the session and its players, so it can be captured on the
+    // strand of the map while the other maps keep running.
+    class SessionSerializer {
+    public:
+        SessionSerializer() = default;
+
+        SessionSerializer(const model::GameSession& game_session, const players::Players::SessionPlayers& players)
+                : map_id_(*game_session.GetMap().GetId())
+                , game_session_(game_session) {
+
+            for(const auto& player : players) {
+                players_.push_back(players::PlayerSerializer(player));
+                dogs_.push_back(model::DogSerializer(player.GetDog()));
+            }
+        }
+
+        void Restore(model::Game& game, players::Players& players) const;
+
+        template <typename Archive>
+        void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+            ar& map_id_;
+            ar& game_session_;
+            ar& players_;
+            ar& dogs_;
+        }
+
+    private:
+        std::string map_id_;
+        model::GameSessionSerializer game_session_;
+        std::vector<players::PlayerSerializer> players_;
+        std::vector<model::DogSerializer> dogs_;
+    };
+
     class ApplicationSerializer {
     public:
         ApplicationSerializer() = default;
@@ -236,19 +261,15 @@ namespace serializer {
         explicit ApplicationSerializer(const model::Game& game, const players::Players& players, const players::PlayerTokens& tokens)
                     : game_(model::GameSerializer(game))
                     , tokens_(players::TokensSerializer(tokens)) {
-                
-                for(const auto& player : players.GetConstPlayers()) 
-                    players_.push_back(players::PlayerSerializer(*player));
-
-                for(const auto& map : game.GetMaps()) {
-                    model::Map::Id map_id = map.GetId();
-                    if(game.GetGameSessions().contains(map_id)) 
-                        game_sessions_.push_back(model::GameSessionSerializer(game.GetGameSessions().at(map_id)));
-                }
-
-                for(const auto& player : players.GetConstPlayers()) {
-                    dogs_.push_back(model::DogSerializer(player->GetDog()));
-                }
+
+                for(const auto& [map_id, game_session] : game.GetGameSessions())
+                    sessions_.push_back(SessionSerializer(game_session, players.GetPlayers(map_id)));
+            }
+
+        ApplicationSerializer(model::GameSerializer game, players::TokensSerializer tokens, std::vector<SessionSerializer> sessions)
+                    : game_(std::move(game))
+                    , tokens_(std::move(tokens))
+                    , sessions_(std::move(sessions)) {
             }
         
         void Restore(model::Game& game, players::Players& players, players::PlayerTokens& tokens) const;
@@ -257,19 +278,17 @@ namespace serializer {
         void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
             ar& game_;
             ar& tokens_;
-            ar& players_;
-            ar& game_sessions_;
-            ar& dogs_;
+            ar& sessions_;
         }
 
     private:
         model::GameSerializer game_;
         players::TokensSerializer tokens_;
-        std::vector<players::PlayerSerializer> players_;
-        std::vector<model::GameSessionSerializer> game_sessions_;
-        std::vector<model::DogSerializer> dogs_;
+        std::vector<SessionSerializer> sessions_;
     };  
 
+    void SerializeGame(const std::string& path, const ApplicationSerializer& app_serializer);
+
     void SerializeGame(const std::string& path, const model::Game& game, 
                         const players::Players& players, const players::PlayerTokens& tokens);
 
@@ -0,0 +1,56 @@
+#pragma once
+
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/buffer.hpp>
+#include <boost/beast/core/error.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/optional.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace http_server {
+
+    namespace net = boost::asio;
+    namespace beast = boost::beast;
+    namespace http = beast::http;
+
+    // Body that sends a string shared with other responses without copying it.
+    // The string must not change while a response holding it is written.
+    struct SharedStringBody {
+        using value_type = std::shared_ptr<const std::string>;
+
+        static std::uint64_t size(const value_type& body) noexcept {
+            return body ? body->size() : 0;
+        }
+
+        class writer {
+        public:
+            using const_buffers_type = net::const_buffer;
+
+            template <bool isRequest, class Fields>
+            writer(const http::header<isRequest, Fields>&, const value_type& body)
+                : body_(body) {
+            }
+
+            void init(beast::error_code& ec) {
+                ec = {};
+            }
+
+            boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec) {
+                ec = {};
+                if (!body_) {
+                    return boost::none;
+                }
+                return {{const_buffers_type{body_->data(), body_->size()}, false}};
+            }
+
+        private:
+            const value_type& body_;
+        };
+    };
+
+}  // namespace http_server
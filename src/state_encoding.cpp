@@ -0,0 +1,88 @@
+#include "state_encoding.h"
+
+#include <cmath>
+
+namespace game_state::binary {
+
+namespace {
+
+void PutUvar(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void PutSvar(std::string& out, int64_t value) {
+    PutUvar(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void PutFixed(std::string& out, double value) {
+    PutSvar(out, std::llround(std::ldexp(value, FRACTION_BITS)));
+}
+
+void PutId(std::string& out, int id) {
+    PutUvar(out, static_cast<uint32_t>(id));
+}
+
+uint8_t DirectionCode(const std::string& dir) {
+    if (dir == "U" || dir == "D" || dir == "L" || dir == "R") {
+        return static_cast<uint8_t>(dir[0]);
+    }
+    return 0;
+}
+
+}  // namespace
+
+void Encode(std::string& out, uint64_t tick, bool full, std::span<const PlayerState> players, std::span<const int> removed_players,
+            std::span<const LootState> loot, std::span<const int> removed_loot) {
+    // A player takes about 20 bytes and a loot item about 8, so the body is
+    // seldom reallocated while it is written.
+    size_t bag_items = 0;
+    for (const auto& player : players) {
+        bag_items += player.bag.size();
+    }
+    out.reserve(out.size() + 32 + players.size() * 24 + bag_items * 4 + loot.size() * 12
+                + (removed_players.size() + removed_loot.size()) * 3);
+
+    out.push_back('G');
+    out.push_back('S');
+    out.push_back(static_cast<char>(VERSION));
+    out.push_back(static_cast<char>(full ? FLAG_FULL : 0));
+    PutUvar(out, tick);
+
+    PutUvar(out, players.size());
+    for (const auto& player : players) {
+        PutId(out, player.id);
+        PutFixed(out, player.pos.x);
+        PutFixed(out, player.pos.y);
+        PutFixed(out, player.speed.x);
+        PutFixed(out, player.speed.y);
+        out.push_back(static_cast<char>(DirectionCode(player.dir)));
+        PutSvar(out, player.score);
+        PutUvar(out, player.bag.size());
+        for (const auto& item : player.bag) {
+            PutUvar(out, static_cast<uint32_t>(item.type));
+            PutId(out, item.id);
+        }
+    }
+    PutUvar(out, removed_players.size());
+    for (int id : removed_players) {
+        PutId(out, id);
+    }
+
+    PutUvar(out, loot.size());
+    for (const auto& item : loot) {
+        PutId(out, item.id);
+        PutUvar(out, static_cast<uint32_t>(item.type));
+        PutFixed(out, item.pos.x);
+        PutFixed(out, item.pos.y);
+    }
+    PutUvar(out, removed_loot.size());
+    for (int id : removed_loot) {
+        PutId(out, id);
+    }
+}
+
+}  // namespace game_state::binary
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "model.h"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace game_state {
+
+struct BagItemState {
+    int id = 0;
+    int type = 0;
+};
+
+struct PlayerState {
+    int id = 0;
+    std::string name;
+    model::Dog::Coords pos;
+    model::Dog::Speed speed;
+    std::string dir;
+    std::vector<BagItemState> bag;
+    int score = 0;
+    // Only players that are online may read the state; the others are still
+    // shown to them. Not part of any body.
+    bool online = true;
+};
+
+struct LootState {
+    int id = 0;
+    int type = 0;
+    model::Dog::Coords pos;
+};
+
+// Compact binary form of a game state, sent instead of JSON to the clients that
+// accept CONTENT_TYPE. It carries the same players and loot as the JSON bodies:
+//
+//   state   = 'G' 'S' version:u8 flags:u8 tick:uvar
+//             count:uvar player*   count:uvar removed_player_id:uvar*
+//             count:uvar loot*     count:uvar removed_loot_id:uvar*
+//   player  = id:uvar x:fixed y:fixed speed_x:fixed speed_y:fixed dir:u8
+//             score:svar count:uvar (loot_type:uvar loot_id:uvar)*
+//   loot    = id:uvar type:uvar x:fixed y:fixed
+//
+// uvar is an unsigned LEB128 varint and svar a zigzag-encoded one. fixed is a
+// svar of the value times 2^FRACTION_BITS rounded to the nearest integer, so it
+// is within 1/512 of the value. dir is the ASCII code of U, D, L or R and 0 for
+// any other direction, which is a stopped dog. Flag FULL marks the whole state;
+// without it the lists are what changed since the tick the client asked about,
+// as in the JSON delta. A full state has no removed ids.
+namespace binary {
+
+constexpr std::string_view CONTENT_TYPE = "application/x-game-state";
+constexpr uint8_t VERSION = 1;
+constexpr uint8_t FLAG_FULL = 1;
+constexpr int FRACTION_BITS = 8;
+
+// Appends the encoded state to out.
+void Encode(std::string& out, uint64_t tick, bool full, std::span<const PlayerState> players, std::span<const int> removed_players,
+            std::span<const LootState> loot, std::span<const int> removed_loot);
+
+}  // namespace binary
+
+}  // namespace game_state
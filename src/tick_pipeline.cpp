@@ -0,0 +1,211 @@
+#include "tick_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+
+namespace model {
+
+namespace {
+
+// Only the dogs that moved during the tick can collect anything, so gatherer
+// ids index the given rows rather than the whole dog table.
+std::vector<collision_detector::Gatherer> MakeDogGatherers(const DogTable& dogs, std::span<const size_t> rows) {
+    std::vector<collision_detector::Gatherer> gatherers;
+    gatherers.reserve(rows.size());
+    double width = 0.6;
+    for (size_t i : rows) {
+        gatherers.emplace_back(geom::Point2D{dogs.start_x[i], dogs.start_y[i]}, geom::Point2D{dogs.x[i], dogs.y[i]}, width);
+    }
+    return gatherers;
+}
+
+class LootGathererProvider {
+public:
+    LootGathererProvider(const GameSession& session, std::vector<collision_detector::Gatherer> gatherers)
+        : gatherers_(std::move(gatherers))
+    {
+        const auto& loot_objects = session.GetLootObjects();
+        items_.reserve(loot_objects.Size());
+        loot_handles_.reserve(loot_objects.Size());
+        loot_objects.ForEach([this](GameSession::LootHandle handle, const LootObject& loot) {
+            const auto& position = loot.GetPosition();
+            double width = 0.0;
+            items_.emplace_back(geom::Point2D{position.x, position.y}, width);
+            loot_handles_.push_back(handle);
+        });
+    }
+
+    std::span<const collision_detector::Item> GetItems() const noexcept {
+        return items_;
+    }
+
+    std::span<const collision_detector::Gatherer> GetGatherers() const noexcept {
+        return gatherers_;
+    }
+
+    GameSession::LootHandle GetLootHandle(size_t idx) const {
+        return loot_handles_[idx];
+    }
+
+private:
+    std::vector<collision_detector::Item> items_;
+    std::vector<GameSession::LootHandle> loot_handles_;
+    std::vector<collision_detector::Gatherer> gatherers_;
+};
+
+}  // namespace
+
+TickResult TickPipeline::Run(std::chrono::milliseconds delta) {
+    const int msc_in_sec = 1000;
+    const double time_delta = 1.0 * delta.count() / msc_in_sec;
+
+    using Phase = TickProfiler::Phase;
+    TickResult result;
+    {
+        TickProfiler::Scope scope(profiler_, Phase::LOOT_GEN);
+        GenerateLoot(delta);
+    }
+    session_.AddTime(time_delta);
+    {
+        TickProfiler::Scope scope(profiler_, Phase::ADVANCE);
+        Advance(time_delta);
+    }
+    {
+        TickProfiler::Scope scope(profiler_, Phase::RETIRE);
+        Retire(result);
+    }
+    {
+        TickProfiler::Scope scope(profiler_, Phase::GATHER);
+        Gather();
+    }
+    {
+        TickProfiler::Scope scope(profiler_, Phase::DEPOSIT);
+        Deposit(result);
+    }
+    return result;
+}
+
+void TickPipeline::GenerateLoot(std::chrono::milliseconds delta) {
+    session_.GenerateLoot(delta);
+}
+
+void TickPipeline::Advance(double time_delta) {
+    DogTable& dogs = session_.GetDogTable();
+    const RoadNetwork& roads = session_.GetMap().GetRoadNetwork();
+    dogs.clock += time_delta;
+
+    // Dogs that stop leave the active list, so walk a copy of it. The copy is
+    // also the list of dogs that moved during the tick.
+    moved_.assign(dogs.active.begin(), dogs.active.end());
+    for (size_t i : moved_) {
+        if (dogs.flags[i] & DogTable::RETIRED) {
+            dogs.SetSpeed(i, 0.0, 0.0);
+            continue;
+        }
+
+        // A dog is active for the whole tick it has been running in, even if
+        // it stops at the end of the road.
+        dogs.last_activity[i] = dogs.CurrentTime(i);
+
+        const auto movement = roads.Move(dogs.x[i], dogs.y[i], dogs.vx[i], dogs.vy[i], time_delta);
+        if (movement.stopped) {
+            dogs.SetSpeed(i, 0.0, 0.0);
+        }
+        dogs.start_x[i] = dogs.x[i];
+        dogs.start_y[i] = dogs.y[i];
+        dogs.x[i] = movement.x;
+        dogs.y[i] = movement.y;
+    }
+
+    // Rows are queued here when their dog stops, by this tick or by an action
+    // since the last one. A queued row may have started again or been reused
+    // by another dog since, so each is checked before it is armed.
+    for (size_t i : dogs.stopped) {
+        if (i < dogs.Size() && !dogs.IsActive(i) && !(dogs.flags[i] & DogTable::RETIRED)
+            && !session_.GetRetirementWheel().Contains(dogs.retire_timer[i])) {
+            ArmRetirement(i);
+        }
+    }
+    dogs.stopped.clear();
+}
+
+uint64_t TickPipeline::RetirementDeadline(size_t dog) const {
+    const DogTable& dogs = session_.GetDogTable();
+    // Tick deltas are whole milliseconds, so rounding gives back the exact
+    // moment the idle time reaches the retirement time.
+    const double remaining = dogs.last_activity[dog] + retirement_time_ - dogs.CurrentTime(dog);
+    return session_.GetClockMs() + (remaining > 0.0 ? std::llround(remaining * 1000) : 0);
+}
+
+void TickPipeline::ArmRetirement(size_t dog) {
+    DogTable& dogs = session_.GetDogTable();
+    dogs.retire_timer[dog] = session_.GetRetirementWheel().Schedule(RetirementDeadline(dog), {dog, dogs.last_activity[dog]});
+}
+
+void TickPipeline::Retire(TickResult& result) {
+    DogTable& dogs = session_.GetDogTable();
+    std::vector<RetirementTimer> expired;
+    session_.GetRetirementWheel().Advance(session_.GetClockMs(), expired);
+    for (const auto& timer : expired) {
+        const size_t i = timer.dog;
+        if (dogs.flags[i] & DogTable::RETIRED) {
+            continue;
+        }
+        // A dog that is running again is armed by the advance phase once it
+        // stops; one that ran and stopped in between waits from its new stop.
+        if (dogs.IsActive(i)) {
+            continue;
+        }
+        if (dogs.last_activity[i] != timer.last_activity && RetirementDeadline(i) > session_.GetClockMs()) {
+            ArmRetirement(i);
+            continue;
+        }
+
+        dogs.flags[i] |= DogTable::RETIRED;
+        session_.AddRetiredOne();
+        result.retired_dogs.push_back(i);
+    }
+    // Timers fire tick by tick, while the records of a tick are kept by row.
+    std::sort(result.retired_dogs.begin(), result.retired_dogs.end());
+}
+
+void TickPipeline::Gather() {
+    if (moved_.empty()) {
+        return;
+    }
+
+    LootGathererProvider provider(session_, MakeDogGatherers(session_.GetDogTable(), moved_));
+    for (const auto& event : collision_detector::FindGatherEvents(provider)) {
+        // An item taken by an earlier event of this tick is already gone.
+        const auto handle = provider.GetLootHandle(event.item_id);
+        const LootObject* loot = session_.GetLootObjects().Get(handle);
+        if (!loot) {
+            continue;
+        }
+
+        Dog dog(session_.GetDogTable(), moved_[event.gatherer_id]);
+        if (dog.TakeLoot(*loot)) {
+            session_.DeleteLootObject(handle);
+        }
+    }
+}
+
+void TickPipeline::Deposit(TickResult& result) {
+    if (moved_.empty()) {
+        return;
+    }
+
+    const auto gatherers = MakeDogGatherers(session_.GetDogTable(), moved_);
+    const LootTypeCatalog& loot_types = session_.GetMap().GetLootTypeCatalog();
+    for (const auto& event : collision_detector::FindGatherEvents(session_.GetMap().GetOfficeIndex(), gatherers)) {
+        const size_t dog_index = moved_[event.gatherer_id];
+        Dog dog(session_.GetDogTable(), dog_index);
+        for (const auto& loot : dog.ReturnLoot()) {
+            result.deposits.push_back({dog_index, loot.GetType(), loot_types.GetValue(loot.GetType())});
+            session_.ReleaseLootId(loot.GetId());
+        }
+    }
+}
+
+}  // namespace model
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "model.h"
+#include "tick_profiler.h"
+
+#include <chrono>
+#include <vector>
+
+namespace model {
+
+// Outcome of a tick that the model cannot apply itself: players and the
+// records database live outside of it.
+struct TickResult {
+    struct Deposit {
+        size_t dog;
+        int loot_type;
+        int value;
+    };
+
+    std::vector<size_t> retired_dogs;
+    std::vector<Deposit> deposits;
+};
+
+// One step of the simulation of a game session. The step is split into phases
+// that each run over all the dogs of the session at once:
+//   loot-gen - spawns new loot on the roads;
+//   advance  - moves the dogs along the roads. Only the dogs on the active
+//              list of the dog table are touched, and only they are
+//              gatherers in the phases below;
+//   retire   - retires the dogs that stayed idle for too long. Dogs are armed
+//              on the session's retirement wheel when they stand still, so
+//              only the dogs whose timer expired are looked at;
+//   gather   - puts the loot the dogs ran over into their bags;
+//   deposit  - empties the bags of the dogs that passed an office.
+// Both the ticker and the test tick endpoint run the whole pipeline. With a
+// profiler, Run times every phase into it.
+class TickPipeline {
+public:
+    TickPipeline(GameSession& session, double retirement_time, TickProfiler* profiler = nullptr)
+        : session_(session)
+        , retirement_time_(retirement_time)
+        , profiler_(profiler)
+    {
+    }
+
+    TickResult Run(std::chrono::milliseconds delta);
+
+    void GenerateLoot(std::chrono::milliseconds delta);
+    void Advance(double time_delta);
+    void Retire(TickResult& result);
+    void Gather();
+    void Deposit(TickResult& result);
+
+private:
+    uint64_t RetirementDeadline(size_t dog) const;
+    void ArmRetirement(size_t dog);
+
+    GameSession& session_;
+    double retirement_time_;
+    TickProfiler* profiler_;
+    std::vector<size_t> moved_;
+};
+
+}  // namespace model
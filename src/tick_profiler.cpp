@@ -0,0 +1,29 @@
+#include "tick_profiler.h"
+
+namespace model {
+
+std::string_view TickProfiler::GetPhaseName(Phase phase) noexcept {
+    switch (phase) {
+    case Phase::LOOT_GEN:
+        return "lootGen";
+    case Phase::ADVANCE:
+        return "advance";
+    case Phase::RETIRE:
+        return "retire";
+    case Phase::GATHER:
+        return "gather";
+    case Phase::DEPOSIT:
+        return "deposit";
+    case Phase::RECORDS:
+        return "records";
+    case Phase::SESSION:
+        return "session";
+    case Phase::SNAPSHOT:
+        return "snapshot";
+    case Phase::SAVE:
+        return "save";
+    }
+    return "unknown";
+}
+
+}  // namespace model
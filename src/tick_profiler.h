@@ -0,0 +1,93 @@
+#pragma once
+
+#include "util/latency_histogram.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace model {
+
+// Where the time of a tick goes. Every phase has a histogram of its duration
+// in nanoseconds; sessions of different maps record into the same profiler
+// from their own strands.
+class TickProfiler {
+public:
+    enum class Phase {
+        LOOT_GEN,
+        ADVANCE,
+        RETIRE,
+        GATHER,
+        DEPOSIT,
+        RECORDS,
+        SESSION,
+        SNAPSHOT,
+        SAVE,
+    };
+
+    constexpr static size_t PHASE_COUNT = static_cast<size_t>(Phase::SAVE) + 1;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Records the time from its construction to its destruction. A null
+    // profiler makes it do nothing, so the pipeline can run unprofiled.
+    class Scope {
+    public:
+        Scope(TickProfiler* profiler, Phase phase) noexcept
+            : profiler_(profiler)
+            , phase_(phase)
+            , start_(profiler ? Clock::now() : Clock::time_point{}) {
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            if (profiler_) {
+                profiler_->Record(phase_, Clock::now() - start_);
+            }
+        }
+
+    private:
+        TickProfiler* profiler_;
+        Phase phase_;
+        Clock::time_point start_;
+    };
+
+    // A zero period means ticks are driven through the API and never overrun.
+    explicit TickProfiler(std::chrono::milliseconds tick_period = std::chrono::milliseconds::zero())
+        : tick_period_(tick_period) {
+    }
+
+    void Record(Phase phase, Clock::duration duration) noexcept {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        histograms_[static_cast<size_t>(phase)].Record(ns > 0 ? static_cast<uint64_t>(ns) : 0);
+        if (phase == Phase::SESSION && tick_period_.count() > 0 && duration > tick_period_) {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    const util::LatencyHistogram& GetHistogram(Phase phase) const noexcept {
+        return histograms_[static_cast<size_t>(phase)];
+    }
+
+    // Session ticks that took longer than the tick period.
+    uint64_t GetOverruns() const noexcept {
+        return overruns_.load(std::memory_order_relaxed);
+    }
+
+    std::chrono::milliseconds GetTickPeriod() const noexcept {
+        return tick_period_;
+    }
+
+    static std::string_view GetPhaseName(Phase phase) noexcept;
+
+private:
+    std::chrono::milliseconds tick_period_;
+    std::array<util::LatencyHistogram, PHASE_COUNT> histograms_;
+    std::atomic<uint64_t> overruns_ = 0;
+};
+
+}  // namespace model
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+
+namespace util {
+
+// Log-linear histogram of non-negative values in the manner of HdrHistogram:
+// values below SUB_BUCKETS are counted exactly, larger ones in buckets that
+// split every power of two into SUB_BUCKETS / 2 parts, so a reported value is
+// within 1/64 of the recorded one. Values above MAX_VALUE are counted as it.
+//
+// Recording is a few relaxed atomic adds, so any thread may record while
+// another reads; a reader sees each counter on its own, not a consistent cut.
+class LatencyHistogram {
+public:
+    constexpr static unsigned SUB_BUCKET_BITS = 7;
+    constexpr static uint64_t SUB_BUCKETS = uint64_t{1} << SUB_BUCKET_BITS;
+    constexpr static unsigned MAX_VALUE_BITS = 40;
+    constexpr static uint64_t MAX_VALUE = (uint64_t{1} << MAX_VALUE_BITS) - 1;
+    constexpr static size_t BUCKETS = SUB_BUCKETS + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * (SUB_BUCKETS / 2);
+
+    void Record(uint64_t value) noexcept {
+        value = std::min(value, MAX_VALUE);
+        counts_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (max < value && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t Count() const noexcept {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Max() const noexcept {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t Sum() const noexcept {
+        return sum_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t CountInBucket(size_t bucket) const noexcept {
+        return counts_[bucket].load(std::memory_order_relaxed);
+    }
+
+    double Mean() const noexcept {
+        const uint64_t count = Count();
+        return count ? static_cast<double>(Sum()) / count : 0.0;
+    }
+
+    // The highest value that falls in the same bucket as the value below which
+    // the given percentage of the records lie.
+    uint64_t ValueAtPercentile(double percentile) const noexcept {
+        const uint64_t count = Count();
+        if (count == 0) {
+            return 0;
+        }
+        const double clamped = std::clamp(percentile, 0.0, 100.0);
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(clamped / 100.0 * count + 0.5));
+        uint64_t seen = 0;
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket) {
+            seen += CountInBucket(bucket);
+            if (seen >= rank) {
+                return std::min(HighestInBucket(bucket), Max());
+            }
+        }
+        return Max();
+    }
+
+    static size_t BucketOf(uint64_t value) noexcept {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        const unsigned shift = std::bit_width(value) - SUB_BUCKET_BITS;
+        return SUB_BUCKETS + (shift - 1) * (SUB_BUCKETS / 2) + ((value >> shift) - SUB_BUCKETS / 2);
+    }
+
+    static uint64_t HighestInBucket(size_t bucket) noexcept {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        const size_t offset = bucket - SUB_BUCKETS;
+        const unsigned shift = offset / (SUB_BUCKETS / 2) + 1;
+        const uint64_t top = offset % (SUB_BUCKETS / 2) + SUB_BUCKETS / 2;
+        return ((top + 1) << shift) - 1;
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_{};
+    std::atomic<uint64_t> count_ = 0;
+    std::atomic<uint64_t> sum_ = 0;
+    std::atomic<uint64_t> max_ = 0;
+};
+
+}  // namespace util
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Reference to an element of a SlabPool. The generation tells apart the
+// elements that have lived in the same slot, so a handle to an erased element
+// never resolves to whatever took its place.
+template <typename T>
+struct Handle {
+    constexpr static uint32_t INVALID_INDEX = UINT32_MAX;
+
+    uint32_t index = INVALID_INDEX;
+    uint32_t generation = 0;
+
+    bool IsValid() const noexcept {
+        return index != INVALID_INDEX;
+    }
+
+    auto operator<=>(const Handle&) const = default;
+};
+
+// Elements stored by value in one contiguous array of slots. Erased slots are
+// kept in a free list and reused by later insertions with a bumped generation.
+// Lookups by handle are a bounds check and a generation compare.
+//
+// Insertions may reallocate the slots, so pointers and references to elements
+// only stay valid until the next insertion; handles stay valid until erased.
+template <typename T>
+class SlabPool {
+public:
+    using Handle = util::Handle<T>;
+
+    template <typename... Args>
+    Handle Emplace(Args&&... args) {
+        uint32_t index;
+        if (!free_.empty()) {
+            index = free_.back();
+            free_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        }
+        Slot& slot = slots_[index];
+        slot.value.emplace(std::forward<Args>(args)...);
+        ++size_;
+        return {index, slot.generation};
+    }
+
+    bool Erase(Handle handle) {
+        if (!Contains(handle)) {
+            return false;
+        }
+        Slot& slot = slots_[handle.index];
+        slot.value.reset();
+        ++slot.generation;
+        free_.push_back(handle.index);
+        --size_;
+        return true;
+    }
+
+    bool Contains(Handle handle) const noexcept {
+        return handle.index < slots_.size() && slots_[handle.index].generation == handle.generation
+            && slots_[handle.index].value.has_value();
+    }
+
+    T* Get(Handle handle) noexcept {
+        return Contains(handle) ? &*slots_[handle.index].value : nullptr;
+    }
+
+    const T* Get(Handle handle) const noexcept {
+        return Contains(handle) ? &*slots_[handle.index].value : nullptr;
+    }
+
+    size_t Size() const noexcept {
+        return size_;
+    }
+
+    bool Empty() const noexcept {
+        return size_ == 0;
+    }
+
+    void Clear() {
+        for (uint32_t index = 0; index < slots_.size(); ++index) {
+            Erase({index, slots_[index].generation});
+        }
+    }
+
+    // Calls fn(handle, element) for every live element in slot order.
+    template <typename Fn>
+    void ForEach(Fn&& fn) {
+        for (uint32_t index = 0; index < slots_.size(); ++index) {
+            if (slots_[index].value) {
+                fn(Handle{index, slots_[index].generation}, *slots_[index].value);
+            }
+        }
+    }
+
+    template <typename Fn>
+    void ForEach(Fn&& fn) const {
+        for (uint32_t index = 0; index < slots_.size(); ++index) {
+            if (slots_[index].value) {
+                fn(Handle{index, slots_[index].generation}, *slots_[index].value);
+            }
+        }
+    }
+
+    template <typename Pool, typename Value>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::remove_const_t<Value>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        Iterator() = default;
+
+        Iterator(Pool* pool, uint32_t index)
+            : pool_(pool)
+            , index_(index) {
+            SkipFree();
+        }
+
+        Value& operator*() const {
+            return *pool_->slots_[index_].value;
+        }
+
+        Value* operator->() const {
+            return &*pool_->slots_[index_].value;
+        }
+
+        Iterator& operator++() {
+            ++index_;
+            SkipFree();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result = *this;
+            ++*this;
+            return result;
+        }
+
+        bool operator==(const Iterator& other) const noexcept {
+            return index_ == other.index_;
+        }
+
+    private:
+        void SkipFree() {
+            while (index_ < pool_->slots_.size() && !pool_->slots_[index_].value) {
+                ++index_;
+            }
+        }
+
+        Pool* pool_ = nullptr;
+        uint32_t index_ = 0;
+    };
+
+    using iterator = Iterator<SlabPool, T>;
+    using const_iterator = Iterator<const SlabPool, const T>;
+
+    iterator begin() {
+        return {this, 0};
+    }
+
+    iterator end() {
+        return {this, static_cast<uint32_t>(slots_.size())};
+    }
+
+    const_iterator begin() const {
+        return {this, 0};
+    }
+
+    const_iterator end() const {
+        return {this, static_cast<uint32_t>(slots_.size())};
+    }
+
+private:
+    struct Slot {
+        std::optional<T> value;
+        uint32_t generation = 0;
+    };
+
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_;
+    size_t size_ = 0;
+};
+
+}  // namespace util
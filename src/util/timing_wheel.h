@@ -0,0 +1,192 @@
+#pragma once
+
+#include "slab_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+// Hierarchical timing wheel over integer ticks. Level l has SLOTS slots that
+// are SLOTS^l ticks wide each, so a timer is filed by how far away its deadline
+// is and only moves down a level when the wheel reaches the start of its slot.
+// Deadlines past the last level wait in an overflow list that is refiled each
+// time the whole wheel turns over.
+//
+// Timers live in a slab pool, so cancelling one is O(1) and the handle can be
+// used to reach its payload. Cancelled timers leave stale handles in the slots
+// that are skipped when the slot comes due.
+template <typename T>
+class TimingWheel {
+public:
+    struct Timer {
+        uint64_t deadline;
+        T value;
+    };
+
+    using TimerHandle = util::Handle<Timer>;
+
+    constexpr static unsigned SLOT_BITS = 6;
+    constexpr static unsigned SLOTS = 1u << SLOT_BITS;
+    constexpr static unsigned LEVELS = 4;
+
+    explicit TimingWheel(uint64_t now = 0)
+        : now_(now) {
+    }
+
+    // A deadline that has already passed fires on the next Advance.
+    TimerHandle Schedule(uint64_t deadline, T value) {
+        TimerHandle handle = timers_.Emplace(Timer{deadline, std::move(value)});
+        File(handle, deadline);
+        return handle;
+    }
+
+    bool Cancel(TimerHandle handle) {
+        return timers_.Erase(handle);
+    }
+
+    bool Contains(TimerHandle handle) const noexcept {
+        return timers_.Contains(handle);
+    }
+
+    T* Get(TimerHandle handle) noexcept {
+        Timer* timer = timers_.Get(handle);
+        return timer ? &timer->value : nullptr;
+    }
+
+    // Moves the wheel to the given tick and appends the values of the timers
+    // whose deadline is not after it to expired, earlier ticks first.
+    // Jumps over the ticks whose slots are empty, so a long step costs a scan of
+    // the slots per non-empty one reached plus the timers that come due or move
+    // down a level, not a visit per elapsed tick.
+    void Advance(uint64_t now, std::vector<T>& expired) {
+        FireDue(expired);
+        if (timers_.Empty()) {
+            // Only stale handles are left in the slots.
+            for (auto& level : levels_) {
+                for (auto& slot : level) {
+                    slot.clear();
+                }
+            }
+            overflow_.clear();
+            now_ = std::max(now_, now);
+            return;
+        }
+
+        while (now_ < now) {
+            const uint64_t next = NextBusyTick();
+            if (next > now) {
+                now_ = now;
+                break;
+            }
+            now_ = next;
+            Cascade();
+            auto& slot = levels_[0][now_ & (SLOTS - 1)];
+            for (TimerHandle handle : slot) {
+                Fire(handle, expired);
+            }
+            slot.clear();
+            FireDue(expired);
+        }
+    }
+
+    uint64_t Now() const noexcept {
+        return now_;
+    }
+
+    size_t Size() const noexcept {
+        return timers_.Size();
+    }
+
+private:
+    using Slot = std::vector<TimerHandle>;
+
+    void File(TimerHandle handle, uint64_t deadline) {
+        if (deadline <= now_) {
+            due_.push_back(handle);
+            return;
+        }
+        // The lowest level whose span around now also holds the deadline.
+        for (unsigned level = 0; level < LEVELS; ++level) {
+            const unsigned shift = SLOT_BITS * (level + 1);
+            if ((deadline >> shift) == (now_ >> shift)) {
+                levels_[level][(deadline >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(handle);
+                return;
+            }
+        }
+        overflow_.push_back(handle);
+    }
+
+    // The first tick after now whose slot on some level holds timers, or the
+    // largest tick if there is none. A slot on a level starts after every slot
+    // of the current turn of the levels below, so the levels are tried from the
+    // bottom and the first slot found is the earliest.
+    uint64_t NextBusyTick() const noexcept {
+        for (unsigned level = 0; level < LEVELS; ++level) {
+            const unsigned shift = SLOT_BITS * level;
+            const uint64_t turn_start = (now_ >> (shift + SLOT_BITS)) << (shift + SLOT_BITS);
+            for (uint64_t slot = ((now_ >> shift) & (SLOTS - 1)) + 1; slot < SLOTS; ++slot) {
+                if (!levels_[level][slot].empty()) {
+                    return turn_start + (slot << shift);
+                }
+            }
+        }
+        if (!overflow_.empty()) {
+            constexpr unsigned WHEEL_BITS = SLOT_BITS * LEVELS;
+            return ((now_ >> WHEEL_BITS) + 1) << WHEEL_BITS;
+        }
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    // Refiles the timers of the slots that start at the current tick, higher
+    // levels first so that their timers are spread before the lower levels are.
+    void Cascade() {
+        unsigned top = 0;
+        while (top < LEVELS && (now_ & ((uint64_t{1} << (SLOT_BITS * (top + 1))) - 1)) == 0) {
+            ++top;
+        }
+        if (top == LEVELS) {
+            Refile(overflow_);
+            --top;
+        }
+        for (unsigned level = top; level > 0; --level) {
+            Refile(levels_[level][(now_ >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+        }
+    }
+
+    void Refile(Slot& slot) {
+        Slot handles;
+        handles.swap(slot);
+        for (TimerHandle handle : handles) {
+            if (const Timer* timer = timers_.Get(handle)) {
+                File(handle, timer->deadline);
+            }
+        }
+    }
+
+    void FireDue(std::vector<T>& expired) {
+        for (TimerHandle handle : due_) {
+            Fire(handle, expired);
+        }
+        due_.clear();
+    }
+
+    void Fire(TimerHandle handle, std::vector<T>& expired) {
+        if (Timer* timer = timers_.Get(handle)) {
+            expired.push_back(std::move(timer->value));
+            timers_.Erase(handle);
+        }
+    }
+
+    uint64_t now_;
+    SlabPool<Timer> timers_;
+    std::array<std::array<Slot, SLOTS>, LEVELS> levels_;
+    Slot overflow_;
+    Slot due_;
+};
+
+}  // namespace util
@@ -8,7 +8,10 @@
 
 #include "../src/collision_detector.h"
 
+#include <algorithm>
+#include <random>
 #include <sstream>
+#include <tuple>
 
 using namespace std::literals;
 
@@ -94,6 +97,48 @@ private:
     std::vector<Gatherer> gatherers_;
 };
 
+struct SpanProvider {
+    std::span<const collision_detector::Item> GetItems() const {
+        return items;
+    }
+    std::span<const collision_detector::Gatherer> GetGatherers() const {
+        return gatherers;
+    }
+
+    std::vector<collision_detector::Item> items;
+    std::vector<collision_detector::Gatherer> gatherers;
+};
+
+static_assert(collision_detector::GathererProvider<SpanProvider>);
+
+// Searches that compute times in a different way may order events whose times
+// differ only by rounding either way, so they are matched within a tolerance:
+// the times come in the same order and every (item, gatherer) pair is found
+// by both.
+void CheckSameEvents(const std::vector<collision_detector::GatheringEvent>& events,
+                     const std::vector<collision_detector::GatheringEvent>& reference) {
+    constexpr double TIME_TOLERANCE = 1e-12;
+    REQUIRE(events.size() == reference.size());
+    for(size_t i = 0; i < events.size(); ++i) {
+        CHECK_THAT(events[i].time, Catch::Matchers::WithinAbs(reference[i].time, TIME_TOLERANCE));
+    }
+
+    auto by_pair = [](std::vector<collision_detector::GatheringEvent> sorted) {
+        std::sort(sorted.begin(), sorted.end(), [](const auto& lhs, const auto& rhs) {
+            return std::tie(lhs.item_id, lhs.gatherer_id) < std::tie(rhs.item_id, rhs.gatherer_id);
+        });
+        return sorted;
+    };
+    const auto sorted_events = by_pair(events);
+    const auto sorted_reference = by_pair(reference);
+    for(size_t i = 0; i < sorted_events.size(); ++i) {
+        CHECK(sorted_events[i].item_id == sorted_reference[i].item_id);
+        CHECK(sorted_events[i].gatherer_id == sorted_reference[i].gatherer_id);
+        CHECK_THAT(sorted_events[i].time, Catch::Matchers::WithinAbs(sorted_reference[i].time, TIME_TOLERANCE));
+    }
+}
+static_assert(!collision_detector::GathererProvider<TestItemGathererPrivider>);
+
 SCENARIO("Gathering events") {
     
     GIVEN("gatherer, 2 items in path and 1 item not in path") {
@@ -142,3 +187,118 @@ SCENARIO("Gathering events") {
 
     }
 }
+
+
+SCENARIO("Grid search matches brute force") {
+    GIVEN("many items and gatherers moving along the axes") {
+        std::mt19937 random{42};
+        std::uniform_real_distribution<double> coord{-20.0, 20.0};
+        std::uniform_real_distribution<double> step{-5.0, 5.0};
+        std::uniform_real_distribution<double> width{0.0, 0.6};
+
+        std::vector<collision_detector::Item> items;
+        for(int i = 0; i < 500; ++i) {
+            items.emplace_back(geom::Point2D{coord(random), coord(random)}, width(random));
+        }
+        std::vector<collision_detector::Gatherer> gatherers;
+        for(int i = 0; i < 100; ++i) {
+            geom::Point2D start{coord(random), coord(random)};
+            geom::Point2D end = i % 2 ? geom::Point2D{start.x + step(random), start.y} : geom::Point2D{start.x, start.y + step(random)};
+            gatherers.emplace_back(start, end, width(random));
+        }
+        TestItemGathererPrivider provider{items, gatherers};
+
+        WHEN("the same items are given as arrays") {
+            auto events = collision_detector::FindGatherEvents(SpanProvider{items, gatherers});
+            auto reference = collision_detector::FindGatherEvents(provider);
+
+            THEN("the same events are found") {
+                CheckSameEvents(events, reference);
+            }
+        }
+
+        WHEN("the items are indexed in advance") {
+            const collision_detector::ItemIndex index(items);
+            auto events = collision_detector::FindGatherEvents(index, gatherers);
+            auto reference = collision_detector::FindGatherEventsBruteForce(provider);
+
+            THEN("the same events are found") {
+                CHECK(index.Size() == items.size());
+                CheckSameEvents(events, reference);
+            }
+        }
+
+        WHEN("events are searched with the grid and by brute force") {
+            auto events = collision_detector::FindGatherEvents(provider);
+            auto reference = collision_detector::FindGatherEventsBruteForce(provider);
+
+            THEN("the same events are found in the same order") {
+                REQUIRE(!reference.empty());
+                CheckSameEvents(events, reference);
+            }
+        }
+    }
+}
+
+SCENARIO("Events at the same time") {
+    GIVEN("two gatherers on the same path reaching two items at once") {
+        std::vector<collision_detector::Item> items = {
+            {{5.0, 0.1}, 0.0},
+            {{5.0, 0.0}, 0.0},
+        };
+        std::vector<collision_detector::Gatherer> gatherers = {
+            {{0.0, 0.0}, {10.0, 0.0}, 0.3},
+            {{0.0, 0.0}, {10.0, 0.0}, 0.3},
+        };
+
+        WHEN("events are searched") {
+            auto events = collision_detector::FindGatherEvents(TestItemGathererPrivider{items, gatherers});
+
+            THEN("they are ordered by item and then by gatherer") {
+                REQUIRE(events.size() == 4);
+                CHECK((events[0].item_id == 0 && events[0].gatherer_id == 0));
+                CHECK((events[1].item_id == 0 && events[1].gatherer_id == 1));
+                CHECK((events[2].item_id == 1 && events[2].gatherer_id == 0));
+                CHECK((events[3].item_id == 1 && events[3].gatherer_id == 1));
+            }
+        }
+    }
+}
+
+SCENARIO("Batched collection") {
+    GIVEN("a gatherer and a batch of items that does not fill whole vector lanes") {
+        std::mt19937 random{7};
+        std::uniform_real_distribution<double> coord{-3.0, 3.0};
+        std::uniform_real_distribution<double> width{0.0, 0.6};
+        std::vector<double> xs, ys, widths;
+        for(int i = 0; i < 37; ++i) {
+            xs.push_back(coord(random));
+            ys.push_back(coord(random) / 4);
+            widths.push_back(width(random));
+        }
+        geom::Point2D start{-2.0, 0.0};
+        geom::Point2D end{2.0, 0.0};
+        const double gatherer_width = 0.3;
+
+        WHEN("the batch is tried at once") {
+            std::vector<collision_detector::CollectHit> hits;
+            collision_detector::TryCollectPoints(start, end, gatherer_width, xs, ys, widths, hits);
+
+            THEN("it finds the same items as trying them one by one") {
+                std::vector<collision_detector::CollectHit> expected;
+                for(size_t i = 0; i < xs.size(); ++i) {
+                    auto result = collision_detector::TryCollectPoint(start, end, {xs[i], ys[i]});
+                    if(result.IsCollected(gatherer_width + widths[i]))
+                        expected.push_back({i, result.sq_distance, result.proj_ratio});
+                }
+                REQUIRE(!expected.empty());
+                REQUIRE(hits.size() == expected.size());
+                for(size_t i = 0; i < hits.size(); ++i) {
+                    CHECK(hits[i].item == expected[i].item);
+                    CHECK_THAT(hits[i].sq_distance, Catch::Matchers::WithinAbs(expected[i].sq_distance, 1e-12));
+                    CHECK_THAT(hits[i].proj_ratio, Catch::Matchers::WithinAbs(expected[i].proj_ratio, 1e-12));
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/game_state.h"
+
+using namespace std::literals;
+
+namespace {
+
+using namespace game_state;
+
+// Stands in for a WebSocket connection: keeps the frames sent to it.
+class FakeConnection {
+public:
+    struct SentFrame {
+        StateBody frame;
+        bool droppable;
+        bool binary;
+    };
+
+    bool IsOpen() const noexcept {
+        return open;
+    }
+
+    void Send(StateBody frame, bool droppable, bool binary) {
+        frames.push_back({std::move(frame), droppable, binary});
+    }
+
+    bool open = true;
+    std::vector<SentFrame> frames;
+};
+
+}  // namespace
+
+SCENARIO("State stream") {
+    using namespace model;
+
+    GIVEN("a snapshot of a session with a player") {
+        Game game(1s, 1.0);
+        Map map(Map::Id{"map1"}, "Map 1", 1);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 10));
+        game.AddMap(map);
+        GameSession& game_session = game.StartGameSession(map);
+        players::Players players(game);
+        players.Add(game_session.AddDog("dog"), game_session);
+        const SnapshotPtr snapshot = WorldSnapshot::CaptureTick(game_session, players.GetPlayers(map.GetId()), nullptr);
+
+        AND_GIVEN("a JSON and a binary connection subscribed to it") {
+            auto json_connection = std::make_shared<FakeConnection>();
+            auto binary_connection = std::make_shared<FakeConnection>();
+            StateSubscribers subscribers;
+            subscribers.Add(MakeStreamSink(std::weak_ptr(json_connection), Encoding::JSON));
+            subscribers.Add(MakeStreamSink(std::weak_ptr(binary_connection), Encoding::BINARY));
+
+            WHEN("the state is pushed") {
+                subscribers.Push(*snapshot);
+
+                THEN("each connection gets the full state in its encoding as a droppable frame") {
+                    REQUIRE(json_connection->frames.size() == 1);
+                    CHECK(json_connection->frames[0].frame == snapshot->GetFullStateBody(Encoding::JSON));
+                    CHECK(json_connection->frames[0].droppable);
+                    CHECK_FALSE(json_connection->frames[0].binary);
+                    REQUIRE(binary_connection->frames.size() == 1);
+                    CHECK(binary_connection->frames[0].frame == snapshot->GetFullStateBody(Encoding::BINARY));
+                    CHECK(binary_connection->frames[0].binary);
+                    CHECK(subscribers.Size() == 2);
+                }
+            }
+
+            WHEN("a connection closes") {
+                subscribers.Push(*snapshot);
+                json_connection->open = false;
+                subscribers.Push(*snapshot);
+                subscribers.Push(*snapshot);
+
+                THEN("it gets no more frames and is unsubscribed") {
+                    CHECK(json_connection->frames.size() == 1);
+                    CHECK(binary_connection->frames.size() == 3);
+                    CHECK(subscribers.Size() == 1);
+                }
+            }
+
+            WHEN("a connection is gone") {
+                binary_connection.reset();
+                subscribers.Push(*snapshot);
+
+                THEN("it is unsubscribed") {
+                    CHECK(json_connection->frames.size() == 1);
+                    CHECK(subscribers.Size() == 1);
+                }
+            }
+        }
+    }
+}
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <vector>
 
 #include <catch2/catch_test_macros.hpp>
 
@@ -73,3 +74,54 @@ SCENARIO("Loot generation") {
         }
     }
 }
+
+SCENARIO("Random engine") {
+    using loot_gen::RandomEngine;
+
+    GIVEN("two engines with the same seed") {
+        RandomEngine first{42};
+        RandomEngine second{42};
+
+        THEN("they produce the same sequence") {
+            for (int i = 0; i < 100; ++i) {
+                REQUIRE(first() == second());
+            }
+        }
+
+        THEN("an engine with another seed does not") {
+            RandomEngine other{43};
+            int equal = 0;
+            for (int i = 0; i < 100; ++i) {
+                equal += first() == other();
+            }
+            CHECK(equal == 0);
+        }
+    }
+
+    GIVEN("an engine") {
+        RandomEngine engine{7};
+
+        WHEN("items are drawn from a small range") {
+            std::vector<int> hits(5, 0);
+            bool in_range = true;
+            for (int i = 0; i < 5000; ++i) {
+                const unsigned item = loot_gen::GetRandomItem(engine, 4);
+                in_range = in_range && item <= 4;
+                if (item <= 4) {
+                    ++hits[item];
+                }
+            }
+
+            THEN("every item of the range comes up, and nothing outside it") {
+                CHECK(in_range);
+                for (int count : hits) {
+                    CHECK(count > 800);
+                }
+            }
+        }
+
+        THEN("a range of one item always gives it") {
+            CHECK(loot_gen::GetRandomItem(engine, 0) == 0);
+        }
+    }
+}
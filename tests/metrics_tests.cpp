@@ -0,0 +1,43 @@
+#include <string>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "../src/metrics.h"
+
+using namespace std::literals;
+
+SCENARIO("Metrics exposition") {
+    using metrics::TextWriter;
+
+    GIVEN("a histogram of a few latencies") {
+        util::LatencyHistogram histogram;
+        histogram.Record(20'000);         // 20 us
+        histogram.Record(2'000'000);      // 2 ms
+        histogram.Record(3'000'000'000);  // 3 s
+
+        WHEN("it is written with a label") {
+            TextWriter writer;
+            writer.WriteHelp("latency_seconds"sv, "histogram"sv, "Test latency."sv);
+            writer.WriteHistogram("latency_seconds"sv, TextWriter::Label("route"sv, "maps"sv), histogram);
+            const std::string text = writer.Release();
+
+            THEN("the buckets are cumulative and end with the total") {
+                CHECK(text.starts_with("# HELP latency_seconds Test latency.\n# TYPE latency_seconds histogram\n"s));
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"1e-05\"} 0\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"5e-05\"} 1\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"0.005\"} 2\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"1\"} 2\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"5\"} 3\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_bucket{route=\"maps\",le=\"+Inf\"} 3\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_sum{route=\"maps\"} 3.00202\n"s) != std::string::npos);
+                CHECK(text.find("latency_seconds_count{route=\"maps\"} 3\n"s) != std::string::npos);
+            }
+        }
+    }
+
+    GIVEN("a label value with quotes and backslashes") {
+        THEN("they are escaped") {
+            CHECK(TextWriter::Label("map"sv, "a\"b\\c\nd"sv) == "map=\"a\\\"b\\\\c\\nd\""s);
+        }
+    }
+}
@@ -1,8 +1,15 @@
+#include <algorithm>
 #include <cmath>
+#include <random>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
 
 #include "../src/model.h"
+#include "../src/tick_pipeline.h"
+#include "../src/util/latency_histogram.h"
+#include "../src/util/slab_pool.h"
+#include "../src/util/timing_wheel.h"
 
 using namespace std::literals;
 
@@ -26,13 +33,16 @@ SCENARIO("Dogs generation") {
             THEN("game session is generated") {
                 REQUIRE(*game_session.GetMap().GetId() == *game.GetGameSession(map).GetMap().GetId());
             }
+
+            THEN("the session shares the map loaded into the game") {
+                CHECK(&game_session.GetMap() == game.FindMap(map_id));
+            }
             
             WHEN("add new dog") {
                 THEN("dog is generated") {
                     for(int i = 1; i <= 10; ++i) {
                         game_session.AddDog("name");
-                        int dogs_count = game_session.GetDogs().size();
-                        int loot_count = game_session.GetLootObjects().size();
+                        int dogs_count = game_session.GetDogTable().Size();
                         INFO("dog count" << dogs_count << ", dogs added: " << i); 
                         REQUIRE(dogs_count == i);
                     }
@@ -41,12 +51,507 @@ SCENARIO("Dogs generation") {
                 game_session.AddDog("name");
                 WHEN("set random mode") {
                     THEN("dog located not in 0-point") {
-                        double x = game_session.GetDogs().front()->GetPosition().x;
-                        double y = game_session.GetDogs().front()->GetPosition().y;
+                        Dog dog(game_session.GetDogTable(), 0);
+                        double x = dog.GetPosition().x;
+                        double y = dog.GetPosition().y;
                         CHECK((x != 0. || y != 0.));
                     }
                 }
             }
         }
     }
-}
\ No newline at end of file
+}
+
+SCENARIO("Dog table") {
+    using namespace model;
+
+    GIVEN("a game session") {
+        Game game(1s, 1.0);
+        Map map(Map::Id{"map1"}, "Map 1", 1);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 10));
+        map.SetDogSpeed(2.0);
+        game.AddMap(map);
+        GameSession& game_session = game.StartGameSession(map);
+
+        WHEN("dogs are added") {
+            auto first = game_session.AddDog("first");
+            auto second = game_session.AddDog("second");
+
+            THEN("each dog is a row of the table") {
+                const DogTable& dogs = game_session.GetDogTable();
+                REQUIRE(dogs.Size() == 2);
+                CHECK(first.GetIndex() == 0);
+                CHECK(second.GetIndex() == 1);
+                CHECK(dogs.cold[1].name == "second");
+            }
+
+            THEN("changes made through a dog are stored in its row") {
+                second.SetDirection("R");
+                second.SetPosition(3.0, 0.0);
+                const DogTable& dogs = game_session.GetDogTable();
+                CHECK(dogs.vx[1] == 2.0);
+                CHECK(dogs.vy[1] == 0.0);
+                CHECK(dogs.x[1] == 3.0);
+                CHECK(dogs.vx[0] == 0.0);
+                CHECK(second.GetDirection() == "R");
+            }
+
+            THEN("only the dogs with a speed are on the active list") {
+                second.SetDirection("R");
+                const DogTable& dogs = game_session.GetDogTable();
+                CHECK(dogs.active == std::vector<size_t>{1});
+                CHECK_FALSE(dogs.IsActive(0));
+
+                second.Stop();
+                CHECK(dogs.active.empty());
+                CHECK(dogs.stopped.back() == 1);
+            }
+
+            WHEN("a retired dog is removed") {
+                second.SetDirection("R");
+                first.Retire();
+                game_session.AddRetiredOne();
+                const size_t moved_from = game_session.RemoveDog(first.GetIndex());
+
+                THEN("the last row takes its place") {
+                    const DogTable& dogs = game_session.GetDogTable();
+                    CHECK(moved_from == 1);
+                    REQUIRE(dogs.Size() == 1);
+                    CHECK(dogs.cold[0].name == "second");
+                    CHECK_FALSE(dogs.flags[0] & DogTable::RETIRED);
+                    CHECK(dogs.active == std::vector<size_t>{0});
+                    CHECK(game_session.GetRetired() == 0);
+                    CHECK(game_session.GetNumberOfPlayers() == 1);
+                }
+            }
+        }
+    }
+}
+
+SCENARIO("Road lanes") {
+    using namespace model;
+    using Catch::Matchers::WithinAbs;
+
+    GIVEN("a map with two joined horizontal roads and a crossing vertical road") {
+        Map map(Map::Id{"map1"}, "Map 1", 1);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 10));
+        map.AddRoad(Road(Road::HORIZONTAL, {10, 0}, 20));
+        map.AddRoad(Road(Road::VERTICAL, {5, -3}, 3));
+        map.BuildRoadNetwork();
+        const auto& network = map.GetRoadNetwork();
+
+        THEN("the joined roads make one section along x") {
+            const auto* lane = network.GetHorizontalLanes().Find(0.2, 3.0);
+            REQUIRE(lane != nullptr);
+            CHECK_THAT(lane->begin, WithinAbs(-0.4, 1e-9));
+            CHECK_THAT(lane->end, WithinAbs(20.4, 1e-9));
+        }
+
+        THEN("the crossing road is a section along y") {
+            const auto* lane = network.GetVerticalLanes().Find(5.0, 0.0);
+            REQUIRE(lane != nullptr);
+            CHECK_THAT(lane->begin, WithinAbs(-3.4, 1e-9));
+            CHECK_THAT(lane->end, WithinAbs(3.4, 1e-9));
+        }
+
+        THEN("between two lines only the width of the crossing road is open") {
+            const auto* lane = network.GetHorizontalLanes().Find(1.5, 5.0);
+            REQUIRE(lane != nullptr);
+            CHECK_THAT(lane->begin, WithinAbs(4.6, 1e-9));
+            CHECK_THAT(lane->end, WithinAbs(5.4, 1e-9));
+        }
+
+        THEN("points off the roads have no section") {
+            CHECK(network.GetHorizontalLanes().Find(0.0, 21.0) == nullptr);
+            CHECK(network.GetHorizontalLanes().Find(1.5, 2.0) == nullptr);
+            CHECK(network.GetVerticalLanes().Find(2.0, 2.0) == nullptr);
+        }
+    }
+}
+
+SCENARIO("Road network") {
+    using namespace model;
+    using Catch::Matchers::WithinAbs;
+
+    GIVEN("a map with two joined horizontal roads and a crossing vertical road") {
+        Map map(Map::Id{"map1"}, "Map 1", 1);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 10));
+        map.AddRoad(Road(Road::HORIZONTAL, {10, 0}, 20));
+        map.AddRoad(Road(Road::VERTICAL, {5, -3}, 3));
+        map.BuildRoadNetwork();
+        const auto& network = map.GetRoadNetwork();
+
+        WHEN("a dog runs along the road for a long tick") {
+            auto movement = network.Move(1.0, 0.0, 3.0, 0.0, 5.0);
+
+            THEN("it passes the joint of the roads without stopping") {
+                CHECK_THAT(movement.x, WithinAbs(16.0, 1e-9));
+                CHECK_THAT(movement.y, WithinAbs(0.0, 1e-9));
+                CHECK_FALSE(movement.stopped);
+            }
+        }
+
+        WHEN("a dog runs past the end of the road") {
+            auto movement = network.Move(1.0, 0.0, -3.0, 0.0, 5.0);
+
+            THEN("it stops at the edge of the road") {
+                CHECK_THAT(movement.x, WithinAbs(-0.4, 1e-9));
+                CHECK(movement.stopped);
+            }
+        }
+
+        WHEN("a dog turns onto the crossing road") {
+            auto movement = network.Move(5.0, 0.0, 0.0, 1.0, 10.0);
+
+            THEN("it runs to the end of the crossing road") {
+                CHECK_THAT(movement.x, WithinAbs(5.0, 1e-9));
+                CHECK_THAT(movement.y, WithinAbs(3.4, 1e-9));
+                CHECK(movement.stopped);
+            }
+        }
+
+        WHEN("a dog on the crossing road between two lines moves sideways") {
+            auto movement = network.Move(5.0, 1.5, 1.0, 0.0, 1.0);
+
+            THEN("it is kept within the width of the road") {
+                CHECK_THAT(movement.x, WithinAbs(5.4, 1e-9));
+                CHECK_THAT(movement.y, WithinAbs(1.5, 1e-9));
+                CHECK(movement.stopped);
+            }
+        }
+
+        WHEN("a dog stands still") {
+            auto movement = network.Move(2.0, 0.3, 0.0, 0.0, 1.0);
+
+            THEN("it stays where it is") {
+                CHECK_THAT(movement.x, WithinAbs(2.0, 1e-9));
+                CHECK_THAT(movement.y, WithinAbs(0.3, 1e-9));
+                CHECK_FALSE(movement.stopped);
+            }
+        }
+    }
+}
+
+SCENARIO("Tick pipeline") {
+    using namespace model;
+    using Catch::Matchers::WithinAbs;
+
+    GIVEN("a session with a dog, a loot item and an office on one road") {
+        Game game(1s, 0.0);
+        Map map(Map::Id{"map1"}, "Map 1", 2);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 10));
+        map.AddOffice(Office(Office::Id{"o1"}, {5, 0}, {0, 0}));
+        map.BuildOfficeIndex();
+        LootTypeCatalog loot_types;
+        LootType key;
+        key.name = "key";
+        key.value = 10;
+        loot_types.Add(key);
+        LootType wallet;
+        wallet.name = "wallet";
+        wallet.value = 30;
+        loot_types.Add(wallet);
+        map.SetLootTypeCatalog(std::move(loot_types));
+        map.SetDogSpeed(2.0);
+        map.SetBagCapacity(3);
+        map.BuildRoadNetwork();
+        game.AddMap(map);
+        GameSession& game_session = game.StartGameSession(map);
+        auto dog = game_session.AddDog("dog");
+        game_session.AddNewLoot(LootObject(game_session.AcquireLootId(), 1));
+        TickPipeline pipeline(game_session, 10.0);
+
+        WHEN("a profiled tick runs") {
+            TickProfiler profiler(50ms);
+            TickPipeline profiled(game_session, 10.0, &profiler);
+            profiled.Run(100ms);
+
+            THEN("every pipeline phase records one sample and the others none") {
+                for (auto phase : {TickProfiler::Phase::LOOT_GEN, TickProfiler::Phase::ADVANCE, TickProfiler::Phase::RETIRE,
+                                   TickProfiler::Phase::GATHER, TickProfiler::Phase::DEPOSIT}) {
+                    CHECK(profiler.GetHistogram(phase).Count() == 1);
+                }
+                CHECK(profiler.GetHistogram(TickProfiler::Phase::SESSION).Count() == 0);
+                CHECK(profiler.GetOverruns() == 0);
+            }
+        }
+
+        WHEN("the dog runs over the loot and past the office") {
+            dog.SetDirection("R");
+            auto result = pipeline.Run(3000ms);
+
+            THEN("it moves, picks the loot up and deposits it") {
+                CHECK_THAT(dog.GetPosition().x, WithinAbs(6.0, 1e-9));
+                CHECK(game_session.GetLootObjects().Empty());
+                CHECK(dog.GetBag().empty());
+                REQUIRE(result.deposits.size() == 1);
+                CHECK(result.deposits[0].dog == dog.GetIndex());
+                CHECK(result.deposits[0].loot_type == 1);
+                CHECK(result.deposits[0].value == 30);
+                CHECK(result.retired_dogs.empty());
+            }
+
+            THEN("the id of the deposited loot is reused") {
+                CHECK(game_session.AcquireLootId() == 0);
+                CHECK(game_session.AcquireLootId() == 1);
+            }
+        }
+
+        WHEN("the dog picks the loot up but does not reach the office") {
+            dog.SetDirection("R");
+            pipeline.Run(1000ms);
+
+            THEN("the loot leaves the session but keeps its id") {
+                CHECK(game_session.GetLootObjects().Empty());
+                REQUIRE(dog.GetBag().size() == 1);
+                CHECK(dog.GetBag()[0].GetId() == 0);
+                CHECK(game_session.AcquireLootId() == 1);
+            }
+        }
+
+        WHEN("the dog stays idle for the retirement time") {
+            auto result = pipeline.Run(10000ms);
+
+            THEN("it is retired") {
+                REQUIRE(result.retired_dogs.size() == 1);
+                CHECK(result.retired_dogs[0] == dog.GetIndex());
+                CHECK(dog.IsRetired());
+                CHECK(game_session.GetRetired() == 1);
+            }
+        }
+
+        WHEN("the dog stands still over several ticks") {
+            auto first = pipeline.Run(4000ms);
+            auto second = pipeline.Run(4000ms);
+            auto third = pipeline.Run(2000ms);
+
+            THEN("it is retired on the tick its idle time reaches the retirement time") {
+                CHECK(first.retired_dogs.empty());
+                CHECK(second.retired_dogs.empty());
+                CHECK(third.retired_dogs.size() == 1);
+            }
+        }
+
+        WHEN("the last row is removed while its retirement is armed") {
+            auto other = game_session.AddDog("other");
+            pipeline.Run(1000ms);
+            REQUIRE(game_session.GetRetirementWheel().Size() == 2);
+            game_session.RemoveDog(other.GetIndex());
+
+            THEN("its timer is cancelled and the other one still fires for its row") {
+                CHECK(game_session.GetRetirementWheel().Size() == 1);
+                auto result = pipeline.Run(9000ms);
+                CHECK(result.retired_dogs == std::vector<size_t>{dog.GetIndex()});
+            }
+        }
+
+        WHEN("the dog runs for a while before the deadline") {
+            pipeline.Run(6000ms);
+            dog.SetDirection("R");
+            pipeline.Run(1000ms);
+            dog.SetDirection("");
+            auto before = pipeline.Run(9000ms);
+            auto after = pipeline.Run(1000ms);
+
+            THEN("the idle time is counted from its last move") {
+                CHECK(before.retired_dogs.empty());
+                CHECK(after.retired_dogs.size() == 1);
+            }
+        }
+    }
+}
+SCENARIO("Slab pool") {
+    using Pool = util::SlabPool<std::string>;
+
+    GIVEN("a pool with two elements") {
+        Pool pool;
+        auto first = pool.Emplace("first");
+        auto second = pool.Emplace("second");
+
+        WHEN("an element is erased") {
+            REQUIRE(pool.Erase(first));
+
+            THEN("its handle no longer resolves") {
+                CHECK_FALSE(pool.Contains(first));
+                CHECK(pool.Get(first) == nullptr);
+                CHECK_FALSE(pool.Erase(first));
+                CHECK(pool.Size() == 1);
+                REQUIRE(pool.Get(second));
+                CHECK(*pool.Get(second) == "second");
+            }
+
+            THEN("its slot is reused under a new generation") {
+                auto third = pool.Emplace("third");
+                CHECK(third.index == first.index);
+                CHECK(third.generation != first.generation);
+                CHECK(pool.Get(first) == nullptr);
+                CHECK(*pool.Get(third) == "third");
+            }
+
+            THEN("iteration skips the free slot") {
+                std::vector<std::string> values(pool.begin(), pool.end());
+                CHECK(values == std::vector<std::string>{"second"});
+            }
+        }
+    }
+}
+
+SCENARIO("Timing wheel") {
+    using Wheel = util::TimingWheel<int>;
+
+    GIVEN("timers spread over every level of the wheel") {
+        Wheel wheel(1000);
+        std::mt19937 generator(7);
+        std::uniform_int_distribution<uint64_t> delay(0, 20'000'000);
+        std::vector<std::pair<uint64_t, int>> deadlines;
+        std::vector<Wheel::TimerHandle> handles;
+        for (int i = 0; i < 2000; ++i) {
+            const uint64_t deadline = 1000 + delay(generator) / (1 + i % 4 * 1000);
+            handles.push_back(wheel.Schedule(deadline, i));
+            deadlines.emplace_back(deadline, i);
+        }
+        for (int i = 0; i < 2000; i += 3) {
+            REQUIRE(wheel.Cancel(handles[i]));
+        }
+
+        WHEN("the wheel is advanced in uneven steps") {
+            std::uniform_int_distribution<uint64_t> step(1, 300'000);
+            uint64_t now = 1000;
+            bool in_time = true;
+            std::vector<int> fired;
+            while (wheel.Size() > 0) {
+                const uint64_t previous = now;
+                now += step(generator);
+                std::vector<int> expired;
+                wheel.Advance(now, expired);
+                for (int i : expired) {
+                    in_time = in_time && deadlines[i].first <= now && (deadlines[i].first > previous || previous == 1000);
+                    fired.push_back(i);
+                }
+            }
+
+            THEN("each live timer fires once, on the step that passes its deadline") {
+                std::vector<int> expected;
+                for (int i = 0; i < 2000; ++i) {
+                    if (i % 3 != 0) {
+                        expected.push_back(i);
+                    }
+                }
+                std::sort(fired.begin(), fired.end());
+                CHECK(fired == expected);
+                CHECK(in_time);
+            }
+        }
+    }
+
+    GIVEN("a timer due in the past") {
+        Wheel wheel(100);
+        wheel.Schedule(50, 1);
+
+        THEN("it fires on the next advance") {
+            std::vector<int> expired;
+            wheel.Advance(100, expired);
+            CHECK(expired == std::vector<int>{1});
+        }
+    }
+
+    GIVEN("a few timers hours and days apart") {
+        constexpr uint64_t HOUR = 3'600'000;
+        Wheel wheel(0);
+        wheel.Schedule(500, 1);
+        wheel.Schedule(HOUR, 2);
+        wheel.Schedule(2 * HOUR + 17, 3);
+        wheel.Schedule(30 * 24 * HOUR, 4);
+
+        WHEN("the wheel is advanced by hours and then by weeks in single steps") {
+            std::vector<int> within_hours;
+            wheel.Advance(5 * HOUR, within_hours);
+            const uint64_t after_hours = wheel.Now();
+            std::vector<int> within_weeks;
+            wheel.Advance(40 * 24 * HOUR, within_weeks);
+
+            THEN("each step fires the timers it passes, in order") {
+                CHECK(within_hours == std::vector<int>{1, 2, 3});
+                CHECK(after_hours == 5 * HOUR);
+                CHECK(within_weeks == std::vector<int>{4});
+                CHECK(wheel.Now() == 40 * 24 * HOUR);
+                CHECK(wheel.Size() == 0);
+            }
+        }
+    }
+}
+
+SCENARIO("Spawn sampler") {
+    using namespace model;
+
+    GIVEN("a long and a short road") {
+        SpawnSampler sampler;
+        sampler.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 90));
+        sampler.AddRoad(Road(Road::VERTICAL, {100, 10}, 0));
+        loot_gen::RandomEngine engine{1};
+
+        WHEN("a batch of points is drawn") {
+            std::vector<geom::Point2D> points(10000);
+            sampler.Sample(engine, points);
+
+            THEN("the points lie on the roads in proportion to their length") {
+                int on_long = 0;
+                int on_short = 0;
+                for (const auto& point : points) {
+                    if (point.y == 0.0 && point.x >= 0.0 && point.x <= 90.0) {
+                        ++on_long;
+                    } else if (point.x == 100.0 && point.y >= 0.0 && point.y <= 10.0) {
+                        ++on_short;
+                    }
+                }
+                CHECK(on_long + on_short == 10000);
+                CHECK(on_short > 800);
+                CHECK(on_short < 1200);
+            }
+        }
+    }
+}
+
+SCENARIO("Latency histogram") {
+    using util::LatencyHistogram;
+
+    GIVEN("the bucket layout") {
+        THEN("small values have buckets of their own") {
+            for (uint64_t value = 0; value < LatencyHistogram::SUB_BUCKETS; ++value) {
+                CHECK(LatencyHistogram::BucketOf(value) == value);
+                CHECK(LatencyHistogram::HighestInBucket(value) == value);
+            }
+        }
+
+        THEN("a larger value lies within 1/64 below the top of its bucket") {
+            for (uint64_t value : std::initializer_list<uint64_t>{128, 129, 1000, 65535, 123456789, LatencyHistogram::MAX_VALUE}) {
+                const size_t bucket = LatencyHistogram::BucketOf(value);
+                const uint64_t highest = LatencyHistogram::HighestInBucket(bucket);
+                CHECK(bucket < LatencyHistogram::BUCKETS);
+                CHECK(highest >= value);
+                CHECK(highest - value <= value / 64);
+                CHECK(LatencyHistogram::BucketOf(highest + 1) == bucket + 1);
+            }
+        }
+    }
+
+    GIVEN("the values from 1 to 10000") {
+        LatencyHistogram histogram;
+        for (uint64_t value = 1; value <= 10000; ++value) {
+            histogram.Record(value);
+        }
+
+        THEN("the summary matches them") {
+            CHECK(histogram.Count() == 10000);
+            CHECK(histogram.Max() == 10000);
+            CHECK(histogram.Mean() == 5000.5);
+            for (double percentile : {50.0, 90.0, 99.0}) {
+                const double exact = percentile * 100;
+                const double reported = static_cast<double>(histogram.ValueAtPercentile(percentile));
+                CHECK(reported >= exact);
+                CHECK(reported <= exact * (1.0 + 1.0 / 64));
+            }
+            CHECK(histogram.ValueAtPercentile(100.0) == 10000);
+        }
+    }
+}
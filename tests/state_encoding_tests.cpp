@@ -0,0 +1,319 @@
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/json.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/matchers/catch_matchers_floating_point.hpp>
+
+#include "../src/game_state.h"
+#include "../src/state_encoding.h"
+
+using namespace std::literals;
+
+namespace {
+
+using namespace game_state;
+namespace json = boost::json;
+
+// Values are rounded to the nearest multiple of 2^-FRACTION_BITS.
+constexpr double QUANTUM = 1.0 / (2 << binary::FRACTION_BITS);
+
+// Reads the binary state back as described in state_encoding.h.
+class Decoder {
+public:
+    explicit Decoder(const std::string& data)
+        : data_(data) {
+    }
+
+    struct State {
+        uint64_t tick = 0;
+        bool full = false;
+        std::vector<PlayerState> players;
+        std::vector<int> removed_players;
+        std::vector<LootState> loot;
+        std::vector<int> removed_loot;
+    };
+
+    State Decode() {
+        State state;
+        if (Byte() != 'G' || Byte() != 'S' || Byte() != binary::VERSION) {
+            throw std::runtime_error("Bad header");
+        }
+        state.full = (Byte() & binary::FLAG_FULL) != 0;
+        state.tick = Uvar();
+
+        for (uint64_t count = Uvar(); count > 0; --count) {
+            PlayerState& player = state.players.emplace_back();
+            player.id = static_cast<int>(Uvar());
+            player.pos.x = Fixed();
+            player.pos.y = Fixed();
+            player.speed.x = Fixed();
+            player.speed.y = Fixed();
+            const uint8_t dir = Byte();
+            player.dir = dir ? std::string(1, static_cast<char>(dir)) : ""s;
+            player.score = static_cast<int>(Svar());
+            for (uint64_t items = Uvar(); items > 0; --items) {
+                BagItemState& item = player.bag.emplace_back();
+                item.type = static_cast<int>(Uvar());
+                item.id = static_cast<int>(Uvar());
+            }
+        }
+        for (uint64_t count = Uvar(); count > 0; --count) {
+            state.removed_players.push_back(static_cast<int>(Uvar()));
+        }
+        for (uint64_t count = Uvar(); count > 0; --count) {
+            LootState& item = state.loot.emplace_back();
+            item.id = static_cast<int>(Uvar());
+            item.type = static_cast<int>(Uvar());
+            item.pos.x = Fixed();
+            item.pos.y = Fixed();
+        }
+        for (uint64_t count = Uvar(); count > 0; --count) {
+            state.removed_loot.push_back(static_cast<int>(Uvar()));
+        }
+        if (pos_ != data_.size()) {
+            throw std::runtime_error("Trailing bytes");
+        }
+        return state;
+    }
+
+private:
+    uint8_t Byte() {
+        if (pos_ >= data_.size()) {
+            throw std::runtime_error("Truncated state");
+        }
+        return static_cast<uint8_t>(data_[pos_++]);
+    }
+
+    uint64_t Uvar() {
+        uint64_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            const uint8_t byte = Byte();
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+    }
+
+    int64_t Svar() {
+        const uint64_t value = Uvar();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    double Fixed() {
+        return static_cast<double>(Svar()) / (1 << binary::FRACTION_BITS);
+    }
+
+    const std::string& data_;
+    size_t pos_ = 0;
+};
+
+std::vector<int> IdsFromJson(const json::value& ids) {
+    std::vector<int> result;
+    for (const json::value& id : ids.as_array()) {
+        result.push_back(id.to_number<int>());
+    }
+    return result;
+}
+
+void CheckPoint(const json::value& point, double x, double y) {
+    using Catch::Matchers::WithinAbs;
+    REQUIRE(point.as_array().size() == 2);
+    CHECK_THAT(x, WithinAbs(point.as_array()[0].to_number<double>(), QUANTUM));
+    CHECK_THAT(y, WithinAbs(point.as_array()[1].to_number<double>(), QUANTUM));
+}
+
+// Compares a decoded binary body field by field with the JSON body of the same
+// state. Coordinates may differ by the rounding of the binary form.
+void CheckSameState(const Decoder::State& state, const json::object& json_state) {
+    CHECK(state.tick == json_state.at("tick").to_number<uint64_t>());
+    CHECK(state.full == json_state.at("full").as_bool());
+
+    const json::object& json_players = json_state.at("players").as_object();
+    REQUIRE(state.players.size() == json_players.size());
+    for (const PlayerState& player : state.players) {
+        INFO("player " << player.id);
+        const json::object& json_player = json_players.at(std::to_string(player.id)).as_object();
+        CheckPoint(json_player.at("pos"), player.pos.x, player.pos.y);
+        CheckPoint(json_player.at("speed"), player.speed.x, player.speed.y);
+        CHECK(player.dir == std::string(json_player.at("dir").as_string()));
+        CHECK(player.score == json_player.at("score").to_number<int>());
+        const json::array& json_bag = json_player.at("bag").as_array();
+        REQUIRE(player.bag.size() == json_bag.size());
+        for (size_t i = 0; i < json_bag.size(); ++i) {
+            CHECK(player.bag[i].id == json_bag[i].as_object().at("id").to_number<int>());
+            CHECK(player.bag[i].type == json_bag[i].as_object().at("type").to_number<int>());
+        }
+    }
+
+    const json::object& json_loot = json_state.at("lostObjects").as_object();
+    REQUIRE(state.loot.size() == json_loot.size());
+    for (const LootState& loot : state.loot) {
+        INFO("loot " << loot.id);
+        const json::object& json_item = json_loot.at(std::to_string(loot.id)).as_object();
+        CHECK(loot.type == json_item.at("type").to_number<int>());
+        CheckPoint(json_item.at("pos"), loot.pos.x, loot.pos.y);
+    }
+
+    const json::value* removed_players = json_state.if_contains("removedPlayers");
+    CHECK(state.removed_players == (removed_players ? IdsFromJson(*removed_players) : std::vector<int>{}));
+    const json::value* removed_loot = json_state.if_contains("removedLostObjects");
+    CHECK(state.removed_loot == (removed_loot ? IdsFromJson(*removed_loot) : std::vector<int>{}));
+}
+
+}  // namespace
+
+SCENARIO("Binary state encoding") {
+    using Catch::Matchers::WithinAbs;
+
+    GIVEN("players and loot") {
+        std::vector<PlayerState> players(2);
+        players[0] = {.id = 0, .name = "dog", .pos = {-0.4, 12.3456}, .speed = {0.0, -2.5}, .dir = "U",
+                      .bag = {{.id = 300, .type = 2}, {.id = 7, .type = 0}}, .score = 70000, .online = true};
+        players[1] = {.id = 129, .name = "cat", .pos = {1000.001, 0.0}, .speed = {0.0, 0.0}, .dir = "", .bag = {}, .score = 0, .online = true};
+        std::vector<LootState> loot = {{.id = 5, .type = 1, .pos = {3.3, 4.4}}, {.id = 16384, .type = 3, .pos = {0.0, 99.999}}};
+
+        WHEN("the full state is encoded") {
+            std::string body;
+            binary::Encode(body, 42, true, players, {}, loot, {});
+            const auto state = Decoder(body).Decode();
+
+            THEN("it decodes to the same state within the quantum") {
+                CHECK(state.tick == 42);
+                CHECK(state.full);
+                REQUIRE(state.players.size() == players.size());
+                for (size_t i = 0; i < players.size(); ++i) {
+                    INFO("player " << i);
+                    CHECK(state.players[i].id == players[i].id);
+                    CHECK_THAT(state.players[i].pos.x, WithinAbs(players[i].pos.x, QUANTUM));
+                    CHECK_THAT(state.players[i].pos.y, WithinAbs(players[i].pos.y, QUANTUM));
+                    CHECK_THAT(state.players[i].speed.x, WithinAbs(players[i].speed.x, QUANTUM));
+                    CHECK_THAT(state.players[i].speed.y, WithinAbs(players[i].speed.y, QUANTUM));
+                    CHECK(state.players[i].dir == players[i].dir);
+                    CHECK(state.players[i].score == players[i].score);
+                    REQUIRE(state.players[i].bag.size() == players[i].bag.size());
+                    for (size_t j = 0; j < players[i].bag.size(); ++j) {
+                        CHECK(state.players[i].bag[j].id == players[i].bag[j].id);
+                        CHECK(state.players[i].bag[j].type == players[i].bag[j].type);
+                    }
+                }
+                CHECK(state.removed_players.empty());
+                REQUIRE(state.loot.size() == loot.size());
+                for (size_t i = 0; i < loot.size(); ++i) {
+                    CHECK(state.loot[i].id == loot[i].id);
+                    CHECK(state.loot[i].type == loot[i].type);
+                    CHECK_THAT(state.loot[i].pos.x, WithinAbs(loot[i].pos.x, QUANTUM));
+                    CHECK_THAT(state.loot[i].pos.y, WithinAbs(loot[i].pos.y, QUANTUM));
+                }
+                CHECK(state.removed_loot.empty());
+            }
+        }
+
+        WHEN("a change set is encoded") {
+            std::string body;
+            const std::vector<int> removed_players = {3};
+            const std::vector<int> removed_loot = {1, 200};
+            binary::Encode(body, 43, false, std::span(players).subspan(1), removed_players, {}, removed_loot);
+            const auto state = Decoder(body).Decode();
+
+            THEN("the changed and removed entities come back") {
+                CHECK(state.tick == 43);
+                CHECK_FALSE(state.full);
+                REQUIRE(state.players.size() == 1);
+                CHECK(state.players[0].id == 129);
+                CHECK(state.removed_players == removed_players);
+                CHECK(state.loot.empty());
+                CHECK(state.removed_loot == removed_loot);
+            }
+        }
+
+        WHEN("a dog has a direction other than the four") {
+            players[0].dir = "X";
+            std::string body;
+            binary::Encode(body, 1, true, players, {}, {}, {});
+
+            THEN("it is sent as stopped") {
+                CHECK(Decoder(body).Decode().players[0].dir.empty());
+            }
+        }
+    }
+}
+
+SCENARIO("Binary and JSON state bodies") {
+    using namespace model;
+
+    GIVEN("a snapshot of a session with players and loot") {
+        Game game(1s, 1.0);
+        Map map(Map::Id{"map1"}, "Map 1", 1);
+        map.AddRoad(Road(Road::HORIZONTAL, {0, 0}, 1000));
+        map.SetDogSpeed(2.5);
+        game.AddMap(map);
+        GameSession& game_session = game.StartGameSession(map);
+        players::Players players(game);
+
+        Dog dog = game_session.AddDog("dog");
+        dog.SetPosition(12.3456, -0.4);
+        dog.SetDirection("L");
+        dog.SetBagCapacity(3);
+        dog.TakeLoot(LootObject(300, 2));
+        dog.TakeLoot(LootObject(7, 0));
+        const players::PlayerRef first = players.Add(dog, game_session);
+        players.Find(first)->AddValue(70000);
+        Dog cat = game_session.AddDog("cat");
+        cat.SetPosition(999.999, 0.0);
+        const players::PlayerRef second = players.Add(cat, game_session);
+
+        LootObject loot(5, 1);
+        loot.SetPosition(Point{3, 0});
+        game_session.AddLootObject(loot);
+        const auto lost_loot = game_session.AddLootObject(LootObject(16384, 10.001, 0.3));
+
+        auto& session_players = players.GetPlayers(map.GetId());
+        const SnapshotPtr snapshot = WorldSnapshot::CaptureTick(game_session, session_players, nullptr);
+
+        WHEN("the full state is written in both encodings") {
+            const StateBody json_body = snapshot->GetFullStateBody(Encoding::JSON);
+            const StateBody binary_body = snapshot->GetFullStateBody(Encoding::BINARY);
+
+            THEN("both hold the same state") {
+                const auto state = Decoder(*binary_body).Decode();
+                CHECK(state.full);
+                CHECK(state.players.size() == 2);
+                CHECK(state.loot.size() == 2);
+                CheckSameState(state, json::parse(*json_body).as_object());
+            }
+
+            THEN("the binary body is far smaller than the JSON one") {
+                INFO("binary " << binary_body->size() << " bytes, JSON " << json_body->size() << " bytes");
+                CHECK(binary_body->size() * 4 < json_body->size());
+            }
+        }
+
+        WHEN("the state changes over the next tick") {
+            players.Find(second)->GetDog().SetPosition(998.5, 0.25);
+            session_players.Erase(first.handle);
+            game_session.DeleteLootObject(lost_loot);
+            const SnapshotPtr next = WorldSnapshot::CaptureTick(game_session, session_players, snapshot);
+            const StateBody json_body = next->GetStateBodySince(snapshot->GetTick(), Encoding::JSON);
+            const StateBody binary_body = next->GetStateBodySince(snapshot->GetTick(), Encoding::BINARY);
+
+            THEN("both encodings hold the same changes") {
+                const auto state = Decoder(*binary_body).Decode();
+                CHECK_FALSE(state.full);
+                CHECK(state.tick == snapshot->GetTick() + 1);
+                CHECK(state.players.size() == 1);
+                CHECK(state.removed_players == std::vector<int>{first.id});
+                CHECK(state.removed_loot == std::vector<int>{16384});
+                CheckSameState(state, json::parse(*json_body).as_object());
+            }
+
+            THEN("the binary body is smaller than the JSON one") {
+                INFO("binary " << binary_body->size() << " bytes, JSON " << json_body->size() << " bytes");
+                CHECK(binary_body->size() * 4 < json_body->size());
+            }
+        }
+    }
+}